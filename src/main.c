@@ -1,12 +1,560 @@
 #include <flecs_systems_console.h>
 #include <flecs/util/dbg.h>
-
-typedef struct ui_thread_t {
+#include <flecs/util/stats.h>
+#include <stddef.h>
+
+/* Number of slots in a command queue. Must be a power of two. */
+#define CONSOLE_QUEUE_SIZE (64)
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define console_load(ptr) ((uint32_t)_InterlockedOr((volatile long*)(ptr), 0))
+#define console_store(ptr, value) _InterlockedExchange((volatile long*)(ptr), (long)(value))
+#else
+#define console_load(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define console_store(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+#endif
+
+/* Lock-free single producer, single consumer queue. The head is only written
+ * by the consumer, the tail is only written by the producer. */
+typedef struct console_queue_t {
+    void *slots[CONSOLE_QUEUE_SIZE];
+    uint32_t head;
+    uint32_t tail;
+} console_queue_t;
+
+/* Default time a command may run per frame, in microseconds */
+#define CONSOLE_DEFAULT_BUDGET (1000)
+
+/* Returned by a job step when it ran out of budget before it was done */
+#define CONSOLE_MORE (1)
+
+/* Command as it travels from the UI thread to the main thread, and back */
+typedef struct console_cmd_t {
+    char *cmd;
+    int result;
+} console_cmd_t;
+
+/* Position of a listing in the world, so it can be resumed later */
+typedef struct console_cursor_t {
+    int32_t table;
+    int32_t row;
+} console_cursor_t;
+
+typedef struct ui_thread_t ui_thread_t;
+
+typedef enum console_format_t {
+    ConsoleText,
+    ConsoleJson,
+    ConsoleCsv
+} console_format_t;
+
+/* Column of a listing. In text mode columns are padded to width, the last
+ * column should have a width of 0. Values that are NULL are printed as none
+ * in text mode, as null in JSON and as an empty field in CSV. */
+typedef struct console_field_t {
+    const char *label;
+    const char *key;
+    uint32_t width;
+    bool brackets;
+    const char *none;
+} console_field_t;
+
+/* Listing that is written one field at a time */
+typedef struct console_list_t {
+    const console_field_t *fields;
+    console_format_t format;
+    int32_t field;
+    int32_t rows;
+} console_list_t;
+
+/* Single object that is written as a list of key-value pairs */
+typedef struct console_record_t {
+    console_format_t format;
+    uint32_t width;
+    int32_t count;
+} console_record_t;
+
+typedef int (*console_step_t)(
+    ecs_world_t *world,
+    ui_thread_t *ctx);
+
+/* Long running command that is executed in steps across multiple frames */
+typedef struct console_job_t {
+    console_step_t step;
+    console_cursor_t cursor;
+    ecs_type_filter_t filter;
+    bool has_filter;
+    console_list_t list;
+    int32_t limit;            /* max number of rows to show, 0 is no limit */
+    int32_t offset;           /* number of rows to skip before showing rows */
+    int32_t count;            /* number of rows shown */
+    ecs_time_t start;
+    double budget;
+    uint32_t ops;
+} console_job_t;
+
+/* Open addressing hashmap with pointer keys */
+typedef struct console_map_t {
+    const void **keys;
+    void **values;
+    uint32_t size;
+    uint32_t count;
+} console_map_t;
+
+/* Number of threads that evaluate filters in parallel, including the main
+ * thread */
+#define CONSOLE_WORKER_COUNT (4)
+
+/* Tables evaluated per parallel scan. Scans are only dispatched to workers
+ * when at least CONSOLE_SCAN_MIN tables are left and fit in the remaining
+ * frame budget, otherwise tables are filtered on the main thread. */
+#define CONSOLE_SCAN_WINDOW (16384)
+#define CONSOLE_SCAN_MIN (1024)
+
+/* Filter results for a window of tables */
+typedef struct console_scan_t {
+    ecs_type_filter_t filter;
+    int32_t start;            /* index of first table in window */
+    int32_t count;            /* number of tables in window */
+    bool *matches;
+    int32_t size;             /* size of matches */
+    double table_time;        /* time per table of the last scan, in us */
+} console_scan_t;
+
+typedef struct console_pool_t console_pool_t;
+
+typedef struct console_worker_t {
+    console_pool_t *pool;
+    ecs_os_thread_t thread;
+    int32_t index;
+} console_worker_t;
+
+/* Threads that evaluate a scan. Each thread evaluates a contiguous range of
+ * tables, and writes results to its own part of the matches array. */
+struct console_pool_t {
+    console_worker_t workers[CONSOLE_WORKER_COUNT];
+    ecs_os_mutex_t lock;
+    ecs_os_cond_t start;      /* signaled when a scan is ready */
+    ecs_os_cond_t done;       /* signaled when a worker finished a scan */
+    uint32_t generation;      /* incremented for each scan */
+    int32_t finished;         /* workers that finished the current scan */
+    bool started;
+    bool quit;                /* set by scan_stop to end the workers */
+    ecs_world_t *world;
+    console_scan_t *scan;
+};
+
+/* Systems a table is matched with, rendered as a comma separated list */
+typedef struct console_matched_t {
+    uint32_t count;
+    ecs_entity_t *systems;    /* systems the list was rendered for */
+    char *expr;
+} console_matched_t;
+
+/* Index from entity name to entity. Tables are (re)indexed when their
+ * entity count changes, which a sweep checks every frame for a bounded number
+ * of tables. Names that are not indexed are found with a full lookup and then
+ * added. Renamed and deleted entities can leave stale entries, so a result is
+ * verified before it is returned. */
+#define CONSOLE_NAMES_TABLES (1024)
+#define CONSOLE_NAMES_ENTITIES (65536)
+
+typedef struct console_names_t {
+    char **keys;
+    ecs_entity_t *values;
+    uint32_t size;
+    uint32_t count;
+    int32_t *indexed;         /* entity count per table when it was indexed */
+    int32_t indexed_count;
+    bool dirty;               /* new tables must be indexed before lookup */
+    uint32_t version;         /* incremented when a name is added */
+    int32_t cursor;           /* next table to visit in names_update */
+    char **sorted;            /* sorted names, for prefix queries */
+    uint32_t sorted_count;
+    uint32_t sorted_version;
+} console_names_t;
+
+/* Strings that are expensive to render and are shared by many rows. Both
+ * caches are cleared when new tables are created. */
+typedef struct console_cache_t {
+    console_map_t type_exprs; /* ecs_type_t -> char* */
+    console_map_t matched;    /* ecs_table_t* -> console_matched_t* */
+    int32_t table_count;
+    console_names_t names;
+} console_cache_t;
+
+/* Output buffer. Memory is kept between commands, so once the buffer has
+ * grown to the size of a chunk, writing output no longer allocates. */
+typedef struct console_buf_t {
+    char *buf;
+    size_t count;
+    size_t size;
+} console_buf_t;
+
+typedef enum console_cmd_kind_t {
+    ConsoleCmdEntity,
+    ConsoleCmdTable,
+    ConsoleCmdSystem,
+    ConsoleCmdMatch,
+    ConsoleCmdAdd,
+    ConsoleCmdRemove,
+    ConsoleCmdDelete,
+    ConsoleCmdHelp,
+    ConsoleCmdQuit,
+    ConsoleCmdSnapshot,
+    ConsoleCmdRestore,
+    ConsoleCmdBudget,
+    ConsoleCmdNext,
+    ConsoleCmdComplete,
+    ConsoleCmdProfile,
+    ConsoleCmdFrame,
+    ConsoleCmdDiff,
+    ConsoleCmdBegin,
+    ConsoleCmdCommit,
+    ConsoleCmdAbort,
+    ConsoleCmdChurn,
+    ConsoleCmdMemory,
+    ConsoleCmdLayout,
+    ConsoleCmdMatrix,
+    ConsoleCmdCount,
+    ConsoleCmdTop
+} console_cmd_kind_t;
+
+typedef struct console_cmd_desc_t {
+    const char *name;
+    console_cmd_kind_t kind;
+    bool alias;
+} console_cmd_desc_t;
+
+/* Max number of frames that can be profiled in one go */
+#define CONSOLE_PROFILE_MAX_FRAMES (10000)
+
+typedef struct console_profile_system_t {
+    ecs_entity_t system;
+    const char *name;
+    double time_spent;        /* time spent by system at previous sample */
+    float *samples;           /* ring buffer with time per call, in seconds */
+    int32_t calls;
+    uint32_t entities;
+} console_profile_system_t;
+
+/* Per system timings, collected from the world stats once per frame */
+typedef struct console_profile_t {
+    console_profile_system_t *systems; /* sorted by entity id */
+    int32_t count;
+    int32_t frames;           /* number of frames to profile */
+    int32_t sampled;          /* number of frames profiled so far */
+    uint32_t tick;            /* world tick of previous sample */
+    bool measuring;           /* profile holds a measurement reference */
+} console_profile_t;
+
+/* Histogram buckets are powers of two, split up in 2^CONSOLE_HDR_SUB_BITS
+ * linear sub buckets. This keeps the error of a value within ~3%. */
+#define CONSOLE_HDR_SUB_BITS (5)
+#define CONSOLE_HDR_SUB_COUNT (1 << CONSOLE_HDR_SUB_BITS)
+#define CONSOLE_HDR_BUCKETS (40 * CONSOLE_HDR_SUB_COUNT)
+
+/* Histogram with values in microseconds */
+typedef struct console_hdr_t {
+    uint32_t counts[CONSOLE_HDR_BUCKETS];
+    uint32_t total;
+    double max;               /* exact largest value, buckets are rounded */
+} console_hdr_t;
+
+/* Number of frames in a histogram window. Reports combine the current and
+ * the previous window, so they cover the last 1-2 windows of frames. */
+#define CONSOLE_FRAME_WINDOW (1024)
+
+/* Number of pipeline phases, OnLoad to OnStore */
+#define CONSOLE_PHASE_COUNT (8)
+
+/* Frame and phase times. Slot 0 is the frame time, slot 1 to
+ * CONSOLE_PHASE_COUNT are the phases. */
+typedef struct console_frames_t {
+    console_hdr_t hist[2][CONSOLE_PHASE_COUNT + 1];
+    int32_t current;          /* histogram window that is recorded into */
+    int32_t recorded;         /* frames recorded in current window */
+    float times[CONSOLE_FRAME_WINDOW][CONSOLE_PHASE_COUNT + 1];
+    uint64_t count;           /* total number of recorded frames */
+    double phase_spent[CONSOLE_PHASE_COUNT]; /* time spent at previous frame */
+    bool phases;              /* record phase times */
+} console_frames_t;
+
+/* Reference counted memory. When a snapshot is taken, entity arrays and
+ * columns that are equal to a block of a live snapshot share that block. */
+typedef struct console_block_t {
+    int32_t refs;
+    const void *key;          /* hash of the data, computed on first use */
+    size_t size;
+    char data[];
+} console_block_t;
+
+/* Number of tables per frame that are checked for entities that moved, even
+ * when their entity count did not change */
+#define CONSOLE_CHURN_SWEEP (16)
+
+/* Max tables visited and entities checked by churn tracking per frame */
+#define CONSOLE_CHURN_TABLES (1024)
+#define CONSOLE_CHURN_ENTITIES (65536)
+
+/* Number of entities that moved from one table to another */
+typedef struct console_churn_pair_t {
+    int32_t from;             /* table index */
+    int32_t to;
+    int32_t next;             /* next pair with same source, index + 1 */
+    int64_t count;
+} console_churn_pair_t;
+
+/* Table as it was when churn tracking last checked it */
+typedef struct console_churn_table_t {
+    int32_t count;            /* entity count, -1 if never checked */
+    ecs_entity_t *members;    /* sorted entities */
+} console_churn_table_t;
+
+/* Entity that left a table and was not yet found in another table */
+typedef struct console_churn_departed_t {
+    ecs_entity_t entity;
+    int32_t table;
+    uint32_t cycle;           /* cycle in which the entity left */
+} console_churn_departed_t;
+
+/* Table transitions, found by comparing the table of an entity with the
+ * table it was in the previous time its table was checked. Tables are
+ * visited round robin, and a table is checked when its entity count
+ * changed. Tables with moves in and out between visits are caught by a
+ * sweep. Visits and checks per frame are bounded, so after 'churn on' the
+ * entities in the world are indexed over several frames in large worlds.
+ * Entities that left a table and are not found in another table within a
+ * full cycle over the tables were deleted, and are removed from the index. */
+typedef struct console_churn_t {
+    bool enabled;
+    console_map_t entities;   /* entity -> table index + 1 */
+    console_churn_table_t *tables;
+    int32_t table_count;
+    int32_t table_size;
+    int32_t cursor;           /* next table to visit */
+    int32_t sweep;            /* first table of the sweep */
+    uint32_t cycle;           /* number of completed visits of all tables */
+    console_churn_departed_t *departed;
+    int32_t departed_count;
+    int32_t departed_size;
+    console_map_t sources;    /* table index + 1 -> first pair index + 1 */
+    console_churn_pair_t *pairs;
+    int32_t pair_count;
+    int32_t pair_size;
+    uint64_t frames;
+    uint64_t moves;
+} console_churn_t;
+
+/* Values of one component for all entities in a snapshot table */
+typedef struct console_image_column_t {
+    ecs_entity_t component;
+    size_t size;              /* 0 for tags, which have no data */
+    console_block_t *block;
+    char *data;               /* block data */
+} console_image_column_t;
+
+/* Copy of a table, taken together with a snapshot */
+typedef struct console_image_table_t {
+    ecs_type_t type;
+    console_block_t *block;
+    ecs_entity_t *entities;   /* block data */
+    int32_t count;
+    console_image_column_t *columns;
+    int32_t column_count;
+} console_image_table_t;
+
+/* Copy of the non-empty tables in the world, without the tables of components
+ * and systems. The flecs snapshot is opaque, so the console keeps its own copy
+ * of the data, which is used both to compare with and to restore from. */
+typedef struct console_image_t {
+    console_image_table_t *tables;
+    int32_t count;
+    ecs_type_filter_t filter;
+    bool has_filter;
+} console_image_t;
+
+/* Mutations of one entity that are staged in a transaction. Components are
+ * only in add when the entity did not own them, and only in remove when it
+ * did, so an add followed by a remove cancels out. */
+typedef struct console_staged_t {
+    ecs_entity_t entity;
+    ecs_entity_t *add;
+    int32_t add_count;
+    ecs_entity_t *remove;
+    int32_t remove_count;
+    bool delete;
+} console_staged_t;
+
+/* Mutation of all entities that match a filter, staged in a transaction */
+typedef struct console_staged_bulk_t {
+    ecs_type_filter_t filter;
+    ecs_type_t type;
+    console_cmd_kind_t kind;
+    int32_t position;         /* entity operations staged before this one */
+} console_staged_bulk_t;
+
+/* Mutations staged between 'begin' and 'commit'. Operations on the same
+ * entity are merged until a filter operation is staged, which starts a new
+ * run so that operations are applied in the order they were staged. */
+typedef struct console_txn_t {
+    bool active;
+    console_map_t index;      /* entity -> index in staged + 1 */
+    int32_t run_start;        /* first entry of the current run */
+    console_staged_t *staged;
+    int32_t count;
+    int32_t size;
+    console_staged_bulk_t *bulk;
+    int32_t bulk_count;
+    int32_t bulk_size;
+    int32_t commands;         /* number of staged commands */
+    int32_t cancelled;        /* operations that cancelled each other out */
+} console_txn_t;
+
+/* Snapshot file layout. All sections start at a multiple of 8 bytes, so
+ * column data can be used in place when the file is mapped into memory.
+ *
+ * header, filter include and exclude expressions, then for each table:
+ *   table header, type expression, entity block,
+ *   then for each column with data: column header, name, data block
+ *
+ * Strings are stored as a uint32_t length followed by the characters. Values
+ * are stored in the byte order of the machine that wrote the file. Tables of
+ * components and systems are never stored. */
+#define CONSOLE_FILE_MAGIC (0x4e534c46) /* "FLSN" */
+#define CONSOLE_FILE_VERSION (2)
+#define CONSOLE_FILE_LZ (1)
+#define CONSOLE_FILE_FILTER (2)
+
+typedef struct console_file_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    int32_t table_count;
+} console_file_header_t;
+
+typedef struct console_file_table_t {
+    int32_t count;
+    int32_t column_count;     /* columns with data, tags are not stored */
+} console_file_table_t;
+
+typedef struct console_file_column_t {
+    uint64_t component;       /* used when the component has no name */
+    uint64_t size;
+} console_file_column_t;
+
+typedef struct console_file_block_t {
+    uint64_t size;            /* size of the data */
+    uint64_t stored;          /* size in the file, less than size if compressed */
+} console_file_block_t;
+
+/* Table x system match matrix, written by 'matrix file'. Layout:
+ *
+ * header, type expression of each table, then for each system:
+ *   system header, name, then for each container: container header, data
+ *
+ * Each system stores the indices of the tables it matches as a compressed
+ * bitset. Indices are split in a high and low 16 bit part. Low parts with the
+ * same high part are stored in one container, as a sorted array when there
+ * are few, or as a bitmap when there are many. */
+#define CONSOLE_MATRIX_MAGIC (0x584d4c46) /* "FLMX" */
+#define CONSOLE_MATRIX_VERSION (1)
+#define CONSOLE_BITSET_ARRAY_MAX (4096)
+#define CONSOLE_BITSET_WORDS (1024)
+
+typedef struct console_matrix_header_t {
+    uint32_t magic;
+    uint32_t version;
+    int32_t table_count;
+    int32_t system_count;
+} console_matrix_header_t;
+
+typedef struct console_matrix_system_t {
+    uint64_t system;
+    int32_t container_count;
+    int32_t count;
+} console_matrix_system_t;
+
+typedef struct console_matrix_container_t {
+    uint16_t key;             /* high 16 bits of table index */
+    uint16_t is_bitmap;
+    int32_t count;            /* number of low parts in container */
+} console_matrix_container_t;
+
+typedef struct console_bitset_container_t {
+    uint16_t key;
+    int32_t count;
+    uint16_t *array;          /* sorted low parts, NULL if bitmap */
+    uint64_t *bitmap;
+} console_bitset_container_t;
+
+typedef struct console_bitset_t {
+    console_bitset_container_t *containers;
+    int32_t count;
+    int32_t cardinality;
+} console_bitset_t;
+
+/* Hash table size and minimum match length of block compression */
+#define CONSOLE_LZ_HASH_BITS (12)
+#define CONSOLE_LZ_MIN_MATCH (4)
+
+/* Snapshot saved with 'snapshot save' */
+typedef struct console_named_t {
+    char *name;
+    console_image_t *image;
+} console_named_t;
+
+/* Max number of nodes in the command trie */
+#define CONSOLE_TRIE_SIZE (512)
+
+/* Node in the command trie. Nodes are stored in an array, and reference their
+ * first child and next sibling by index. Node 0 is the root. */
+typedef struct console_trie_t {
+    char ch;
+    int16_t child;
+    int16_t sibling;
+    int16_t cmd;              /* command that ends at this node, or -1 */
+    int16_t unique;           /* only command below this node, -1 if none, 
+                               * -2 if there are multiple */
+} console_trie_t;
+
+/* Output is written to stdout once a buffer holds this many bytes */
+#define CONSOLE_CHUNK_SIZE (64 * 1024)
+
+struct ui_thread_t {
     ecs_world_t *world;
     ecs_entity_t console_entity;
-    ecs_os_mutex_t mutex;
-    ecs_snapshot_t *snapshot;
-} ui_thread_t;
+    console_queue_t commands; /* UI thread -> main thread */
+    console_queue_t results;  /* main thread -> UI thread */
+    console_cmd_t *current;   /* command with an unfinished job */
+    console_job_t job;
+    console_job_t next;       /* listing that stopped at its limit */
+    uint32_t budget;          /* time per frame for a job, in microseconds */
+    console_cache_t cache;
+    console_buf_t out;
+    console_format_t format;  /* output format of current command */
+    int32_t limit;            /* --limit of current command */
+    int32_t offset;           /* --offset of current command */
+    bool compress;            /* --compress of current command */
+    char by[32];              /* --by of current command */
+    bool by_component;        /* --by-component of current command */
+    console_trie_t trie[CONSOLE_TRIE_SIZE];
+    int32_t trie_count;
+    console_profile_t profile;
+    console_frames_t *frames;
+    console_churn_t churn;
+    console_image_t *image;   /* snapshot taken with 'snapshot' */
+    console_pool_t pool;
+    console_scan_t scan;
+    console_named_t *named;
+    int32_t named_count;
+    console_txn_t txn;
+    int32_t *peaks;           /* highest entity count seen per table */
+    int32_t peak_count;
+    int32_t measure_refs;     /* commands that need system time measured */
+    bool measure_was_on;      /* was system time measured before console */
+};
 
 typedef struct ConsoleUiThread {
     ecs_os_thread_t thread;
@@ -14,824 +562,7328 @@ typedef struct ConsoleUiThread {
 } ConsoleUiThread;
 
 static
-void show_prompt(void) {
-    printf("\nflecs$ ");
+bool queue_push(
+    console_queue_t *queue,
+    void *value)
+{
+    uint32_t tail = queue->tail;
+    if (tail - console_load(&queue->head) == CONSOLE_QUEUE_SIZE) {
+        return false;
+    }
+
+    queue->slots[tail & (CONSOLE_QUEUE_SIZE - 1)] = value;
+    console_store(&queue->tail, tail + 1);
+
+    return true;
 }
 
 static
-void print_column(
-    const char *fmt,
-    size_t len,
-    ...)
+void* queue_pop(
+    console_queue_t *queue)
 {
-    char buff[1024];
-    va_list args;
-    va_start(args, len);
+    uint32_t head = queue->head;
+    if (head == console_load(&queue->tail)) {
+        return NULL;
+    }
 
-    vsnprintf(buff, 1024, fmt, args);
+    void *value = queue->slots[head & (CONSOLE_QUEUE_SIZE - 1)];
+    console_store(&queue->head, head + 1);
 
-    va_end(args);
+    return value;
+}
 
-    if (len) {
-        printf("%s%*s", buff, (int)(len - strlen(buff)), "");
-    } else {
-        printf("%s\n", buff);
-    }
+static
+uint32_t map_hash(
+    const void *key)
+{
+    uint64_t h = (uintptr_t)key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (uint32_t)h;
 }
 
 static
-void print_line(
-    uint32_t len)
+void** map_ensure(
+    console_map_t *map,
+    const void *key);
+
+static
+void map_grow(
+    console_map_t *map)
 {
-    int i;
-    for (i = 0; i < len; i ++) {
-        printf("-");
+    const void **keys = map->keys;
+    void **values = map->values;
+    uint32_t i, size = map->size;
+
+    map->size = size ? size * 2 : 64;
+    map->count = 0;
+    map->keys = ecs_os_calloc(map->size, sizeof(void*));
+    map->values = ecs_os_calloc(map->size, sizeof(void*));
+
+    for (i = 0; i < size; i ++) {
+        if (keys[i]) {
+            *map_ensure(map, keys[i]) = values[i];
+        }
     }
-    printf("\n");
+
+    ecs_os_free(keys);
+    ecs_os_free(values);
 }
 
+/* Return value slot for key, insert key if it is not yet in the map */
 static
-char* read_cmd(
-    FILE *file) 
+void** map_ensure(
+    console_map_t *map,
+    const void *key)
 {
-    int len = 0, max = 32;
-    char *result = ecs_os_malloc(max + 1);
-
-    for(;;) {
-        char ch = fgetc(file);
-        if(ch == EOF)
-            break;
+    if ((map->count + 1) * 4 > map->size * 3) {
+        map_grow(map);
+    }
 
-        if (ch == '\n') 
-            break;
+    uint32_t mask = map->size - 1;
+    uint32_t i = map_hash(key) & mask;
 
-        if (len >= max) {
-            max *= 2;
-            result = ecs_os_realloc(result, max + 1);
+    while (map->keys[i]) {
+        if (map->keys[i] == key) {
+            return &map->values[i];
         }
 
-        result[len ++] = ch;
+        i = (i + 1) & mask;
     }
 
-    if (result) {
-        result[len] = '\0';
-    }
+    map->keys[i] = key;
+    map->values[i] = NULL;
+    map->count ++;
 
-    return result;  
+    return &map->values[i];
 }
 
 static
-const char* parse_arg(
-    const char *args,
-    char *arg)
+void* map_get(
+    console_map_t *map,
+    const void *key)
 {
-    char *bptr = arg, ch;
-    const char *ptr = args;
-
-    while ((ch = *ptr) && ch && !isspace(ch)) {
-        *bptr = ch;
-        bptr ++;
-        ptr ++;
-    }
-
-    if (!ch) {
+    if (!map->count) {
         return NULL;
     }
 
-    *bptr = '\0';
+    uint32_t mask = map->size - 1;
+    uint32_t i = map_hash(key) & mask;
 
-    return ptr;   
+    while (map->keys[i]) {
+        if (map->keys[i] == key) {
+            return map->values[i];
+        }
+
+        i = (i + 1) & mask;
+    }
+
+    return NULL;
 }
 
+/* Remove key. Entries after it are shifted back, so that lookups that probe
+ * past the removed slot still find them. */
 static
-const char* is_cmd(
-    const char *cmd, 
-    const char *str) 
+void map_remove(
+    console_map_t *map,
+    const void *key)
 {
-    size_t len = strlen(str);
+    if (!map->count) {
+        return;
+    }
 
-    if (!strncmp(cmd, str, len)) {
-        if (cmd[len]) {
-            return cmd + len + 1;
-        }  else {
-            return cmd + len;
+    uint32_t mask = map->size - 1;
+    uint32_t i = map_hash(key) & mask;
+
+    while (map->keys[i] != key) {
+        if (!map->keys[i]) {
+            return;
         }
-    } else if (cmd[0] == str[0] && (!cmd[1] || isspace(cmd[1]))) {
-        if (cmd[1]) {
-            return cmd + 1 + 1;
-        } else {
-            return cmd + 1;
+
+        i = (i + 1) & mask;
+    }
+
+    uint32_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (!map->keys[j]) {
+            break;
+        }
+
+        /* Entry at j can move to i if i is between its home slot and j */
+        uint32_t home = map_hash(map->keys[j]) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            map->keys[i] = map->keys[j];
+            map->values[i] = map->values[j];
+            i = j;
         }
     }
 
-    return NULL;
+    map->keys[i] = NULL;
+    map->values[i] = NULL;
+    map->count --;
 }
 
+/* Remove all keys and free the values */
 static
-void print_entity_header(void)
+void map_clear(
+    console_map_t *map)
 {
-    printf("\n");
-    print_column("id", 6);
-    print_column("name", 20);
-    print_column("type", 0);
-    print_line(6 + 20 + strlen("type"));
+    uint32_t i;
+    for (i = 0; i < map->size; i ++) {
+        if (map->keys[i]) {
+            ecs_os_free(map->values[i]);
+            map->keys[i] = NULL;
+            map->values[i] = NULL;
+        }
+    }
+
+    map->count = 0;
 }
 
+/* Free map storage. Values are owned by the caller. */
 static
-void print_entity_summary(
-    ecs_world_t *world,
-    ecs_entity_t entity,
-    ecs_type_t type)
+void map_free(
+    console_map_t *map)
 {
-    char *type_expr = NULL;
-
-    if (type) {
-        type_expr = ecs_type_to_expr(world, type);
-    }
-
-    const char *name = ecs_get_id(world, entity);
-
-    print_column("%lld", 6, entity == ECS_SINGLETON ? 0 : entity);
-    print_column("%s", 20, name ? name : "");
-    print_column("[%s]", 0, type_expr ? type_expr : "");
-
-    ecs_os_free(type_expr);
+    ecs_os_free(map->keys);
+    ecs_os_free(map->values);
+    *map = (console_map_t){0};
 }
 
+/* Tables are never deleted, so if the table at the previous count exists the
+ * table set has changed. */
 static
-int dump_entities(
+void cache_validate(
     ecs_world_t *world,
-    ecs_type_filter_t *filter) 
+    console_cache_t *cache)
 {
-    print_entity_header();
+    if (!ecs_dbg_get_table(world, cache->table_count)) {
+        return;
+    }
 
-    ecs_table_t *table;
-    int i = 0;
-    while ((table = ecs_dbg_get_table(world, i ++))) {
-        if (filter) {
-            if (!ecs_dbg_filter_table(world, table, filter)) {
-                continue;
-            }
-        }
+    cache->names.dirty = true;
 
-        ecs_dbg_table_t dbg;
-        ecs_dbg_table(world, table, &dbg);
+    while (ecs_dbg_get_table(world, cache->table_count)) {
+        cache->table_count ++;
+    }
 
-        int e;
-        for (e = 0; e < dbg.entities_count; e++) {
-             print_entity_summary(world, dbg.entities[e], dbg.type);
+    uint32_t i;
+    for (i = 0; i < cache->matched.size; i ++) {
+        console_matched_t *matched = cache->matched.values[i];
+        if (matched) {
+            ecs_os_free(matched->systems);
+            ecs_os_free(matched->expr);
         }
     }
 
-    return 0;
+    map_clear(&cache->matched);
+    map_clear(&cache->type_exprs);
 }
 
 static
-ecs_entity_t parse_entity_id(
-    ecs_world_t *world, 
-    const char *id) 
+uint32_t names_hash(
+    const char *name)
 {
-    if (isdigit(id[0])) {
-        return atoi(id);
-    } else {
-        return ecs_lookup(world, id);
+    uint32_t h = 2166136261u;
+    while (*name) {
+        h = (h ^ (unsigned char)*(name ++)) * 16777619u;
     }
+    return h;
 }
 
 static
-bool print_matched_with(
-    ecs_world_t *world,
-    ecs_dbg_table_t *table_dbg)
+ecs_entity_t* names_ensure(
+    console_names_t *names,
+    const char *name);
+
+static
+void names_grow(
+    console_names_t *names)
 {
-    if (table_dbg->systems_matched) {
-        ecs_entity_t *systems = ecs_vector_first(table_dbg->systems_matched);
-        uint32_t i, count = ecs_vector_count(table_dbg->systems_matched);
-        for (i = 0; i < count; i ++) {
-            ecs_entity_t system = systems[i];
-            
-            if (i) {
-                printf(",");
-            }
-            
-            printf("%s", ecs_get_id(world, system));
+    char **keys = names->keys;
+    ecs_entity_t *values = names->values;
+    uint32_t i, size = names->size;
+
+    names->size = size ? size * 2 : 256;
+    names->count = 0;
+    names->keys = ecs_os_calloc(names->size, sizeof(char*));
+    names->values = ecs_os_calloc(names->size, sizeof(ecs_entity_t));
+
+    for (i = 0; i < size; i ++) {
+        if (keys[i]) {
+            *names_ensure(names, keys[i]) = values[i];
+            ecs_os_free(keys[i]);
         }
-
-        return true;
-    } else {
-        return false;
     }
+
+    ecs_os_free(keys);
+    ecs_os_free(values);
 }
 
+/* Return value slot for name, insert name if it is not yet in the index */
 static
-void print_type_details(
-    ecs_world_t *world,
-    ecs_dbg_table_t *dbg_table,
-    uint32_t column_width)
+ecs_entity_t* names_ensure(
+    console_names_t *names,
+    const char *name)
 {
-    print_column("type (shared):", column_width);
-    if (dbg_table->shared) {
-        char *type_expr = ecs_type_to_expr(world, dbg_table->shared);
-        printf("[%s]\n", type_expr);
-        free(type_expr);
-    } else {
-        printf("-\n");
+    if ((names->count + 1) * 4 > names->size * 3) {
+        names_grow(names);
     }
 
-    print_column("type (container):", column_width);
-    if (dbg_table->container) {
-        char *type_expr = ecs_type_to_expr(world, dbg_table->container);
-        printf("[%s]\n", type_expr);
-        free(type_expr);
-    } else {
-        printf("-\n");
-    }
+    uint32_t mask = names->size - 1;
+    uint32_t i = names_hash(name) & mask;
 
-    print_column("child of:", column_width);
-    if (dbg_table->parent_entities) {
-        char *type_expr = ecs_type_to_expr(world, dbg_table->parent_entities);
-        printf("%s\n", type_expr);
-        free(type_expr);        
-    } else {
-        printf("-\n");
-    }
+    while (names->keys[i]) {
+        if (!strcmp(names->keys[i], name)) {
+            return &names->values[i];
+        }
 
-    print_column("inherits from:", column_width);
-    if (dbg_table->base_entities) {
-        char *type_expr = ecs_type_to_expr(world, dbg_table->base_entities);
-        printf("%s\n", type_expr);
-        free(type_expr);        
-    } else {
-        printf("-\n");
+        i = (i + 1) & mask;
     }
+
+    names->keys[i] = ecs_os_strdup(name);
+    names->values[i] = 0;
+    names->count ++;
+    names->version ++;
+
+    return &names->values[i];
 }
 
+/* Return value slot for name, or NULL if name is not in the index */
 static
-int dump_entity(
-    ecs_world_t *world, 
-    ecs_entity_t e) 
-{  
-    int column_width = 24;
-    char *type_expr;
+ecs_entity_t* names_get(
+    console_names_t *names,
+    const char *name)
+{
+    if (!names->count) {
+        return NULL;
+    }
 
-    ecs_dbg_entity_t dbg;
-    ecs_dbg_entity(world, e, &dbg);
+    uint32_t mask = names->size - 1;
+    uint32_t i = names_hash(name) & mask;
 
-    ecs_dbg_table_t dbg_table = {0};
-    if (dbg.table) {
-        ecs_dbg_table(world, dbg.table, &dbg_table);
+    while (names->keys[i]) {
+        if (!strcmp(names->keys[i], name)) {
+            return &names->values[i];
+        }
+
+        i = (i + 1) & mask;
     }
 
-    print_column("id:", column_width);
-    printf("%lld\n", e);
+    return NULL;
+}
 
-    const char *name = ecs_get_id(world, e);
-    if (name) {
-        print_column("name:", column_width);
-        printf("%s\n", name);
+/* Index the names in a table if its size changed since it was last indexed,
+ * return the number of entities indexed */
+static
+int32_t names_index_table(
+    ecs_world_t *world,
+    console_names_t *names,
+    ecs_table_t *table,
+    int32_t index)
+{
+    ecs_type_filter_t filter = {
+        .include = ecs_type(EcsId)
+    };
+
+    if (index >= names->indexed_count) {
+        int32_t count = names->indexed_count ? names->indexed_count : 64;
+        while (count <= index) {
+            count *= 2;
+        }
+
+        names->indexed = ecs_os_realloc(
+            names->indexed, count * sizeof(int32_t));
+        memset(&names->indexed[names->indexed_count], 0, 
+            (count - names->indexed_count) * sizeof(int32_t));
+        names->indexed_count = count;
     }
 
-    type_expr = ecs_type_to_expr(world, dbg.type);
-    print_column("type (owned):", column_width);
-    printf("[%s]\n", type_expr);
-    free(type_expr);
+    if (!ecs_dbg_filter_table(world, table, &filter)) {
+        return 0;
+    }
 
-    print_type_details(world, &dbg_table, column_width);
+    ecs_dbg_table_t dbg;
+    ecs_dbg_table(world, table, &dbg);
 
-    print_column("matched with:", column_width);
-    if (!print_matched_with(world, &dbg_table)) {
-        printf("-");
+    if (dbg.entities_count == names->indexed[index]) {
+        return 0;
     }
-    printf("\n");    
 
-    print_column("is watched:", column_width);
-    printf("%s\n", dbg.is_watched ? "true" : "false");
+    int32_t e;
+    for (e = 0; e < dbg.entities_count; e ++) {
+        const char *name = ecs_get_id(world, dbg.entities[e]);
+        if (name) {
+            *names_ensure(names, name) = dbg.entities[e];
+        }
+    }
 
-    print_column("row:", column_width);
-    printf("%d\n", dbg.row);
+    names->indexed[index] = dbg.entities_count;
 
-    return 0;
+    return dbg.entities_count;
 }
 
+/* Index the names of all tables that were created or changed in size since
+ * they were last indexed. */
 static
-int parse_type_filter(
+void names_refresh(
     ecs_world_t *world,
-    const char *args,
-    ecs_type_filter_t *filter_out) 
-{
-    char *expr = ecs_os_strdup(args + 1);
-    int len = strlen(expr);
-    expr[len - 1] = '\0';
-    filter_out->include = ecs_expr_to_type(world, expr);
-    ecs_os_free(expr);
-    return 0;
-}
-
-static
-int cmd_entity(
-    ecs_world_t *world, 
-    const char *args) 
+    console_names_t *names)
 {
-    if (!args[0]) {
-        return dump_entities(world, NULL);
-    } else if (args[0] == '[') {
-        ecs_type_filter_t filter = {0};
-
-        if (parse_type_filter(world, args, &filter)) {
-            return -1;
-        }
-
-        return dump_entities(world, &filter);
-    } else {
-        ecs_entity_t e = parse_entity_id(world, args);
-        if (!e) {
-            return -1;
-        }
+    ecs_table_t *table;
+    int32_t i = 0;
 
-        return dump_entity(world, e);
+    while ((table = ecs_dbg_get_table(world, i))) {
+        names_index_table(world, names, table, i);
+        i ++;
     }
 
-    return 0;
+    names->dirty = false;
 }
 
 static
-void print_table_summary(
-    ecs_world_t *world,
-    ecs_table_t *table)
+int names_compare(
+    const void *p1,
+    const void *p2)
 {
-    ecs_dbg_table_t dbg;
-    ecs_dbg_table(world, table, &dbg);
+    return strcmp(*(char**)p1, *(char**)p2);
+}
 
-    char *type_expr = NULL;
-    if (dbg.type) {
-        type_expr = ecs_type_to_expr(world, dbg.type);
+/* Rebuild the sorted array for prefix queries if names were added */
+static
+void names_sort(
+    console_names_t *names)
+{
+    if (names->sorted && names->sorted_version == names->version) {
+        return;
     }
 
-    print_column("[%s]", 64, type_expr);
-    print_column("%d", 12, dbg.entities_count);
+    uint32_t i, count = 0;
+    names->sorted = ecs_os_realloc(
+        names->sorted, (names->count + 1) * sizeof(char*));
 
-    ecs_os_free(type_expr);  
-
-    if (!print_matched_with(world, &dbg)) {
-        printf("-");
+    for (i = 0; i < names->size; i ++) {
+        if (names->keys[i] && names->values[i]) {
+            names->sorted[count ++] = names->keys[i];
+        }
     }
 
-    printf("\n");
+    qsort(names->sorted, count, sizeof(char*), names_compare);
+    names->sorted_count = count;
+    names->sorted_version = names->version;
 }
 
+/* Called every frame from EcsRunConsole. Visits a bounded number of tables,
+ * and sorts the names each time all tables have been visited, so that
+ * completion only has to search the sorted array. */
 static
-int dump_tables(
+void names_update(
     ecs_world_t *world,
-    ecs_type_filter_t *filter) 
+    console_names_t *names)
 {
-    printf("\n");
-    print_column("id", 4);
-    print_column("type", 64);
-    print_column("entities", 12);
-    print_column("matched with", 0);
-    print_line(4 + 48 + 16 + strlen("matched with"));
-
-    ecs_table_t *table;
-    int i = 0;
-    while ((table = ecs_dbg_get_table(world, i ++))) {
-        if (filter) {
-            if (!ecs_dbg_filter_table(world, table, filter)) {
-                continue;
+    int32_t i = names->cursor, visited = 0, indexed = 0;
+
+    while (visited < CONSOLE_NAMES_TABLES && indexed < CONSOLE_NAMES_ENTITIES) {
+        ecs_table_t *table = ecs_dbg_get_table(world, i);
+        if (table) {
+            indexed += names_index_table(world, names, table, i);
+            visited ++;
+            i ++;
+        } else {
+            /* All tables were visited, start the next cycle */
+            names_sort(names);
+            if (!i) {
+                break;
             }
+            i = 0;
         }
 
-        print_column("%d", 4, i);
-        print_table_summary(world, table);
+        if (i == names->cursor) {
+            break;
+        }
     }
 
-    return 0;
+    names->cursor = i;
 }
 
 static
-int dump_table(
+ecs_entity_t names_lookup(
     ecs_world_t *world,
-    uint32_t id)
+    console_names_t *names,
+    const char *name)
 {
-    uint32_t column_width = 24;
-
-    ecs_table_t *table = ecs_dbg_get_table(world, id - 1);
-    if (!table) {
-        return -1;
+    if (names->dirty) {
+        names_refresh(world, names);
     }
 
-    ecs_dbg_table_t dbg;
-    ecs_dbg_table(world, table, &dbg);
-
-    char *type_expr = ecs_type_to_expr(world, dbg.type);
-    print_column("type (owned):", column_width);
-    printf("[%s]\n", type_expr);
-    ecs_os_free(type_expr);
-
-    print_type_details(world, &dbg, column_width);
-
-    print_column("entities:", column_width);
-    printf("%d\n", dbg.entities_count);
+    ecs_entity_t *e = names_get(names, name);
+    if (e && *e) {
+        const char *id = ecs_get_id(world, *e);
+        if (id && !strcmp(id, name)) {
+            return *e;
+        }
+    }
 
-    print_column("matched with:", column_width);
-    if (!print_matched_with(world, &dbg)) {
-        printf("-");
+    /* Not indexed or stale, fall back to a full lookup. Only names that exist
+     * are added, so misspelled names do not grow the index. */
+    ecs_entity_t result = ecs_lookup(world, name);
+    if (result) {
+        *names_ensure(names, name) = result;
+    } else if (e) {
+        *e = 0;
     }
-    printf("\n");
 
-    return 0;
+    return result;
 }
 
+/* Find the names that start with prefix. This only searches the sorted array,
+ * which is kept up to date by names_update. */
 static
-int cmd_table(
-    ecs_world_t *world, 
-    const char *args) 
+char** names_prefix(
+    console_names_t *names,
+    const char *prefix,
+    uint32_t *count_out)
 {
-    if (!args[0]) {
-        return dump_tables(world, NULL);
-    } else if (args[0] == '[') {
-        ecs_type_filter_t filter = {0};
-
-        if (parse_type_filter(world, args, &filter)) {
-            return -1;
-        }
+    if (!names->sorted) {
+        *count_out = 0;
+        return NULL;
+    }
 
-        return dump_tables(world, &filter);
-    } else {
-        if (isdigit(args[0])) {
-            int id = atoi(args);
-            dump_table(world, id);
+    /* Binary search for first name that is not smaller than prefix */
+    size_t len = strlen(prefix);
+    uint32_t lo = 0, hi = names->sorted_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (strcmp(names->sorted[mid], prefix) < 0) {
+            lo = mid + 1;
         } else {
-            return -1;
+            hi = mid;
         }
     }
 
-    return 0;
+    uint32_t end = lo;
+    while (end < names->sorted_count && 
+        !strncmp(names->sorted[end], prefix, len)) 
+    {
+        end ++;
+    }
+
+    *count_out = end - lo;
+
+    return &names->sorted[lo];
 }
 
 static
-int print_system_summary(
+const char* cache_type_expr(
     ecs_world_t *world,
-    ecs_entity_t system)
+    console_cache_t *cache,
+    ecs_type_t type)
 {
-    ecs_dbg_col_system_t dbg;
-    if (ecs_dbg_col_system(world, system, &dbg)) {
-        return -1;
+    if (!type) {
+        return "";
     }
-    
-    print_column("%lld", 4, system);
-    print_column("%s", 20, ecs_get_id(world, system));
-    print_column("%d", 18, dbg.active_table_count + dbg.inactive_table_count);
-    print_column("%d", 0, dbg.entities_matched_count);
-    
+
+    char **expr = (char**)map_ensure(&cache->type_exprs, type);
+    if (!*expr) {
+        *expr = ecs_type_to_expr(world, type);
+    }
+
+    return *expr;
+}
+
+/* Return the systems a table is matched with, or NULL if there are none. The
+ * list is rebuilt when the matched systems change. */
+static
+const char* cache_matched_with(
+    ecs_world_t *world,
+    console_cache_t *cache,
+    ecs_table_t *table,
+    ecs_dbg_table_t *table_dbg)
+{
+    if (!table_dbg->systems_matched) {
+        return NULL;
+    }
+
+    uint32_t i, count = ecs_vector_count(table_dbg->systems_matched);
+    console_matched_t **matched = (console_matched_t**)map_ensure(
+        &cache->matched, table);
+
+    ecs_entity_t *systems = ecs_vector_first(table_dbg->systems_matched);
+
+    if (*matched && (*matched)->count == count && 
+        !memcmp((*matched)->systems, systems, count * sizeof(ecs_entity_t))) 
+    {
+        return (*matched)->expr;
+    }
+
+    if (!*matched) {
+        *matched = ecs_os_calloc(1, sizeof(console_matched_t));
+    }
+
+    size_t len = 0;
+
+    for (i = 0; i < count; i ++) {
+        const char *name = ecs_get_id(world, systems[i]);
+        len += (name ? strlen(name) : 0) + 1;
+    }
+
+    char *expr = ecs_os_malloc(len + 1), *ptr = expr;
+    for (i = 0; i < count; i ++) {
+        const char *name = ecs_get_id(world, systems[i]);
+        if (i) {
+            *(ptr ++) = ',';
+        }
+        if (name) {
+            size_t name_len = strlen(name);
+            memcpy(ptr, name, name_len);
+            ptr += name_len;
+        }
+    }
+    *ptr = '\0';
+
+    ecs_os_free((*matched)->expr);
+    (*matched)->expr = expr;
+    (*matched)->count = count;
+    (*matched)->systems = ecs_os_realloc(
+        (*matched)->systems, (count + 1) * sizeof(ecs_entity_t));
+    memcpy((*matched)->systems, systems, count * sizeof(ecs_entity_t));
+
+    return expr;
+}
+
+static
+void job_start(
+    ui_thread_t *ctx,
+    console_step_t step,
+    ecs_type_filter_t *filter)
+{
+    console_job_t *job = &ctx->job;
+
+    /* A new listing replaces the one that 'next' would continue */
+    ctx->next = (console_job_t){0};
+
+    *job = (console_job_t){
+        .step = step,
+        .limit = ctx->limit,
+        .offset = ctx->offset
+    };
+
+    if (filter) {
+        job->filter = *filter;
+        job->has_filter = true;
+    }
+}
+
+/* Skip up to count rows for --offset, return the number of skipped rows */
+static
+int32_t job_skip(
+    console_job_t *job,
+    int32_t count)
+{
+    int32_t skip = job->offset < count ? job->offset : count;
+    job->offset -= skip;
+    return skip;
+}
+
+/* Check whether the listing has shown --limit rows. If so, the job is saved
+ * with its cursor so that the 'next' command can continue where it left. */
+static
+bool job_limit(
+    ui_thread_t *ctx)
+{
+    console_job_t *job = &ctx->job;
+
+    if (!job->limit || job->count < job->limit) {
+        job->count ++;
+        return false;
+    }
+
+    ctx->next = *job;
+    ctx->next.count = 0;
+
+    return true;
+}
+
+/* Check whether a job has used up its budget for this frame. Reading the time
+ * is not free, so only do it once every 64 operations. */
+static
+bool job_expired(
+    console_job_t *job)
+{
+    if ((++ job->ops) & 63) {
+        return false;
+    }
+
+    ecs_time_t start = job->start;
+    return ecs_time_measure(&start) * 1000000.0 > job->budget;
+}
+
+/* Time that is left of the budget of a job for this frame, in us */
+static
+double job_remaining(
+    console_job_t *job)
+{
+    ecs_time_t start = job->start;
+    return job->budget - ecs_time_measure(&start) * 1000000.0;
+}
+
+/* Evaluate the part of a scan that belongs to a worker */
+static
+void scan_range(
+    ecs_world_t *world,
+    console_scan_t *scan,
+    int32_t index)
+{
+    int32_t start = (int64_t)scan->count * index / CONSOLE_WORKER_COUNT;
+    int32_t end = (int64_t)scan->count * (index + 1) / CONSOLE_WORKER_COUNT;
+    int32_t i;
+
+    for (i = start; i < end; i ++) {
+        ecs_table_t *table = ecs_dbg_get_table(world, scan->start + i);
+        scan->matches[i] = 
+            table && ecs_dbg_filter_table(world, table, &scan->filter);
+    }
+}
+
+static
+void* scan_worker(
+    void *arg)
+{
+    console_worker_t *worker = arg;
+    console_pool_t *pool = worker->pool;
+    uint32_t generation = 0;
+
+    ecs_os_mutex_lock(pool->lock);
+
+    while (true) {
+        while (pool->generation == generation && !pool->quit) {
+            ecs_os_cond_wait(pool->start, pool->lock);
+        }
+
+        if (pool->quit) {
+            break;
+        }
+
+        generation = pool->generation;
+        ecs_os_mutex_unlock(pool->lock);
+
+        scan_range(pool->world, pool->scan, worker->index);
+
+        ecs_os_mutex_lock(pool->lock);
+        pool->finished ++;
+        ecs_os_cond_signal(pool->done);
+    }
+
+    ecs_os_mutex_unlock(pool->lock);
+
+    return NULL;
+}
+
+/* Evaluate filter for a window of tables starting at index. The world is not
+ * modified while the main thread waits, so workers can read it safely. */
+static
+void scan_run(
+    ecs_world_t *world,
+    console_pool_t *pool,
+    console_scan_t *scan)
+{
+    int32_t i;
+
+    if (!pool->started) {
+        pool->lock = ecs_os_mutex_new();
+        pool->start = ecs_os_cond_new();
+        pool->done = ecs_os_cond_new();
+
+        /* Worker 0 is the main thread */
+        for (i = 1; i < CONSOLE_WORKER_COUNT; i ++) {
+            pool->workers[i].pool = pool;
+            pool->workers[i].index = i;
+            pool->workers[i].thread = ecs_os_thread_new(
+                scan_worker, &pool->workers[i]);
+        }
+
+        pool->started = true;
+    }
+
+    ecs_os_mutex_lock(pool->lock);
+    pool->world = world;
+    pool->scan = scan;
+    pool->finished = 0;
+    pool->generation ++;
+    ecs_os_cond_broadcast(pool->start);
+    ecs_os_mutex_unlock(pool->lock);
+
+    scan_range(world, scan, 0);
+
+    ecs_os_mutex_lock(pool->lock);
+    while (pool->finished != CONSOLE_WORKER_COUNT - 1) {
+        ecs_os_cond_wait(pool->done, pool->lock);
+    }
+    ecs_os_mutex_unlock(pool->lock);
+}
+
+/* End and join the workers. Called when a job is done, so that no threads
+ * are left waiting while the console is idle. */
+static
+void scan_stop(
+    console_pool_t *pool)
+{
+    int32_t i;
+
+    if (!pool->started) {
+        return;
+    }
+
+    ecs_os_mutex_lock(pool->lock);
+    pool->quit = true;
+    ecs_os_cond_broadcast(pool->start);
+    ecs_os_mutex_unlock(pool->lock);
+
+    for (i = 1; i < CONSOLE_WORKER_COUNT; i ++) {
+        ecs_os_thread_join(pool->workers[i].thread);
+    }
+
+    ecs_os_cond_free(pool->start);
+    ecs_os_cond_free(pool->done);
+    ecs_os_mutex_free(pool->lock);
+
+    *pool = (console_pool_t){0};
+}
+
+/* Test if the table at the job cursor matches the job filter. When many
+ * tables are left, the filter is evaluated by the worker pool for a window
+ * of tables, and results are read back in table order. */
+static
+bool job_filter_table(
+    ecs_world_t *world,
+    ui_thread_t *ctx,
+    ecs_table_t *table)
+{
+    console_job_t *job = &ctx->job;
+    console_scan_t *scan = &ctx->scan;
+    int32_t index = job->cursor.table;
+
+    if (!job->has_filter) {
+        return true;
+    }
+
+    if (scan->filter.include == job->filter.include && 
+        scan->filter.exclude == job->filter.exclude &&
+        index >= scan->start && index < scan->start + scan->count) 
+    {
+        return scan->matches[index - scan->start];
+    }
+
+    /* Size the window so that the scan fits in what is left of the budget,
+     * using the time per table of the previous scan */
+    int32_t remaining = ctx->cache.table_count - index;
+    int32_t window = remaining < CONSOLE_SCAN_WINDOW 
+        ? remaining : CONSOLE_SCAN_WINDOW;
+
+    if (scan->table_time > 0) {
+        double fit = job_remaining(job) / scan->table_time;
+        if (fit < window) {
+            window = fit > 0 ? (int32_t)fit : 0;
+        }
+    } else if (window > CONSOLE_SCAN_MIN) {
+        window = CONSOLE_SCAN_MIN;
+    }
+
+    if (window < CONSOLE_SCAN_MIN) {
+        return ecs_dbg_filter_table(world, table, &job->filter);
+    }
+
+    scan->filter = job->filter;
+    scan->start = index;
+    scan->count = window;
+
+    if (scan->size < scan->count) {
+        scan->matches = ecs_os_realloc(
+            scan->matches, sizeof(bool) * scan->count);
+        scan->size = scan->count;
+    }
+
+    ecs_time_t start;
+    ecs_os_get_time(&start);
+    scan_run(world, &ctx->pool, scan);
+    scan->table_time = ecs_time_measure(&start) * 1000000.0 / window;
+
+    return scan->matches[0];
+}
+
+static
+void show_prompt(void) {
+    printf("\nflecs$ ");
+}
+
+static
+void buf_flush(
+    console_buf_t *out)
+{
+    if (out->count) {
+        fwrite(out->buf, 1, out->count, stdout);
+        fflush(stdout);
+        out->count = 0;
+    }
+}
+
+/* Write output when the buffer holds a full chunk */
+static
+void buf_chunk(
+    console_buf_t *out)
+{
+    if (out->count >= CONSOLE_CHUNK_SIZE) {
+        buf_flush(out);
+    }
+}
+
+/* Make room for at least len bytes, plus a terminating 0 */
+static
+char* buf_reserve(
+    console_buf_t *out,
+    size_t len)
+{
+    if (out->count + len + 1 > out->size) {
+        size_t size = out->size ? out->size : 1024;
+        while (out->count + len + 1 > size) {
+            size *= 2;
+        }
+
+        out->buf = ecs_os_realloc(out->buf, size);
+        out->size = size;
+    }
+
+    return out->buf + out->count;
+}
+
+static
+void buf_strn(
+    console_buf_t *out,
+    const char *str,
+    size_t len)
+{
+    memcpy(buf_reserve(out, len), str, len);
+    out->count += len;
+}
+
+static
+void buf_str(
+    console_buf_t *out,
+    const char *str)
+{
+    buf_strn(out, str, strlen(str));
+}
+
+static
+void buf_char(
+    console_buf_t *out,
+    char ch)
+{
+    *buf_reserve(out, 1) = ch;
+    out->count ++;
+}
+
+static
+void buf_fill(
+    console_buf_t *out,
+    char ch,
+    size_t len)
+{
+    memset(buf_reserve(out, len), ch, len);
+    out->count += len;
+}
+
+/* Append integer without going through the format parser */
+static
+size_t buf_int(
+    console_buf_t *out,
+    int64_t value)
+{
+    char tmp[24], *ptr = &tmp[24];
+    uint64_t v = value < 0 ? -(uint64_t)value : (uint64_t)value;
+
+    do {
+        *(-- ptr) = '0' + (v % 10);
+        v /= 10;
+    } while (v);
+
+    if (value < 0) {
+        *(-- ptr) = '-';
+    }
+
+    size_t len = &tmp[24] - ptr;
+    buf_strn(out, ptr, len);
+    return len;
+}
+
+static
+void buf_vprintf(
+    console_buf_t *out,
+    const char *fmt,
+    va_list args)
+{
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+
+    if (len > 0) {
+        vsnprintf(buf_reserve(out, len), len + 1, fmt, args);
+        out->count += len;
+    }
+}
+
+static
+void buf_printf(
+    console_buf_t *out,
+    const char *fmt,
+    ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    buf_vprintf(out, fmt, args);
+    va_end(args);
+}
+
+/* Pad with spaces until the column that started at start is len wide. A len
+ * of 0 terminates the line. */
+static
+void buf_pad(
+    console_buf_t *out,
+    size_t start,
+    size_t len)
+{
+    if (len) {
+        size_t written = out->count - start;
+        if (written < len) {
+            buf_fill(out, ' ', len - written);
+        }
+    } else {
+        buf_char(out, '\n');
+        buf_chunk(out);
+    }
+}
+
+static
+void print_column_str(
+    console_buf_t *out,
+    const char *str,
+    size_t len)
+{
+    size_t start = out->count;
+    buf_str(out, str);
+    buf_pad(out, start, len);
+}
+
+static
+void print_line(
+    console_buf_t *out,
+    uint32_t len)
+{
+    buf_fill(out, '-', len);
+    buf_char(out, '\n');
+}
+
+static
+char* read_cmd(
+    FILE *file) 
+{
+    int len = 0, max = 32;
+    char *result = ecs_os_malloc(max + 1);
+
+    for(;;) {
+        char ch = fgetc(file);
+        if(ch == EOF)
+            break;
+
+        if (ch == '\n') 
+            break;
+
+        if (len >= max) {
+            max *= 2;
+            result = ecs_os_realloc(result, max + 1);
+        }
+
+        result[len ++] = ch;
+    }
+
+    if (result) {
+        result[len] = '\0';
+    }
+
+    return result;  
+}
+
+static
+const char* parse_arg(
+    const char *args,
+    char *arg)
+{
+    char *bptr = arg, ch;
+    const char *ptr = args;
+
+    while ((ch = *ptr) && ch && !isspace(ch)) {
+        *bptr = ch;
+        bptr ++;
+        ptr ++;
+    }
+
+    if (!ch) {
+        return NULL;
+    }
+
+    *bptr = '\0';
+
+    return ptr;   
+}
+
+static
+void buf_json_str(
+    console_buf_t *out,
+    const char *str)
+{
+    const char *ptr, *start = str;
+
+    buf_char(out, '"');
+    for (ptr = str; *ptr; ptr ++) {
+        char ch = *ptr;
+        if (ch == '"' || ch == '\\' || (unsigned char)ch < 0x20) {
+            buf_strn(out, start, ptr - start);
+            if (ch == '"' || ch == '\\') {
+                buf_char(out, '\\');
+                buf_char(out, ch);
+            } else {
+                buf_printf(out, "\\u%04x", ch);
+            }
+            start = ptr + 1;
+        }
+    }
+    buf_strn(out, start, ptr - start);
+    buf_char(out, '"');
+}
+
+static
+void buf_csv_str(
+    console_buf_t *out,
+    const char *str)
+{
+    if (!strpbrk(str, ",\"\r\n")) {
+        buf_str(out, str);
+        return;
+    }
+
+    const char *ptr;
+    buf_char(out, '"');
+    for (ptr = str; *ptr; ptr ++) {
+        if (*ptr == '"') {
+            buf_char(out, '"');
+        }
+        buf_char(out, *ptr);
+    }
+    buf_char(out, '"');
+}
+
+static
+void list_begin(
+    console_buf_t *out,
+    console_list_t *list,
+    const console_field_t *fields,
+    console_format_t format)
+{
+    const console_field_t *field;
+
+    *list = (console_list_t){
+        .fields = fields,
+        .format = format
+    };
+
+    if (format == ConsoleText) {
+        uint32_t len = 0;
+        buf_char(out, '\n');
+        for (field = fields; field->key; field ++) {
+            print_column_str(out, field->label, field->width);
+            len += field->width ? field->width : strlen(field->label);
+        }
+        print_line(out, len);
+    } else if (format == ConsoleJson) {
+        buf_str(out, "[");
+    } else if (format == ConsoleCsv) {
+        for (field = fields; field->key; field ++) {
+            if (field != fields) {
+                buf_char(out, ',');
+            }
+            buf_str(out, field->key);
+        }
+        buf_char(out, '\n');
+    }
+}
+
+static
+void list_end(
+    console_buf_t *out,
+    console_list_t *list)
+{
+    if (list->format == ConsoleJson) {
+        buf_str(out, list->rows ? "\n]\n" : "]\n");
+    }
+}
+
+/* Start the next field, and return its definition */
+static
+const console_field_t* list_next(
+    console_buf_t *out,
+    console_list_t *list)
+{
+    const console_field_t *field = &list->fields[list->field];
+
+    if (list->format == ConsoleJson) {
+        if (!list->field) {
+            buf_str(out, list->rows ? ",\n{" : "\n{");
+        } else {
+            buf_char(out, ',');
+        }
+        buf_json_str(out, field->key);
+        buf_char(out, ':');
+    } else if (list->format == ConsoleCsv) {
+        if (list->field) {
+            buf_char(out, ',');
+        }
+    }
+
+    return field;
+}
+
+/* Finish the current field, and the row if this was the last field */
+static
+void list_done(
+    console_buf_t *out,
+    console_list_t *list,
+    size_t start)
+{
+    const console_field_t *field = &list->fields[list->field];
+    bool last = !field[1].key;
+
+    if (list->format == ConsoleText) {
+        buf_pad(out, start, last ? 0 : field->width);
+    } else if (last) {
+        if (list->format == ConsoleJson) {
+            buf_char(out, '}');
+            buf_chunk(out);
+        } else {
+            buf_pad(out, start, 0);
+        }
+    }
+
+    if (last) {
+        list->field = 0;
+        list->rows ++;
+    } else {
+        list->field ++;
+    }
+}
+
+static
+void list_str(
+    console_buf_t *out,
+    console_list_t *list,
+    const char *value)
+{
+    const console_field_t *field = list_next(out, list);
+    size_t start = out->count;
+
+    if (list->format == ConsoleText) {
+        if (!value) {
+            buf_str(out, field->none ? field->none : "");
+        } else if (field->brackets) {
+            buf_char(out, '[');
+            buf_str(out, value);
+            buf_char(out, ']');
+        } else {
+            buf_str(out, value);
+        }
+    } else if (list->format == ConsoleJson) {
+        if (value) {
+            buf_json_str(out, value);
+        } else {
+            buf_str(out, "null");
+        }
+    } else if (value) {
+        buf_csv_str(out, value);
+    }
+
+    list_done(out, list, start);
+}
+
+static
+void list_double(
+    console_buf_t *out,
+    console_list_t *list,
+    double value)
+{
+    list_next(out, list);
+    size_t start = out->count;
+    buf_printf(out, "%.2f", value);
+    list_done(out, list, start);
+}
+
+static
+void list_int(
+    console_buf_t *out,
+    console_list_t *list,
+    int64_t value)
+{
+    list_next(out, list);
+    size_t start = out->count;
+    buf_int(out, value);
+    list_done(out, list, start);
+}
+
+static
+void record_begin(
+    console_buf_t *out,
+    console_record_t *record,
+    console_format_t format,
+    uint32_t width)
+{
+    *record = (console_record_t){
+        .format = format,
+        .width = width
+    };
+
+    if (format == ConsoleJson) {
+        buf_char(out, '{');
+    } else if (format == ConsoleCsv) {
+        buf_str(out, "field,value\n");
+    }
+}
+
+static
+void record_end(
+    console_buf_t *out,
+    console_record_t *record)
+{
+    if (record->format == ConsoleJson) {
+        buf_str(out, "}\n");
+    }
+}
+
+static
+void record_key(
+    console_buf_t *out,
+    console_record_t *record,
+    const char *label,
+    const char *key)
+{
+    if (record->format == ConsoleText) {
+        size_t start = out->count;
+        buf_str(out, label);
+        buf_char(out, ':');
+        buf_pad(out, start, record->width);
+    } else if (record->format == ConsoleJson) {
+        if (record->count) {
+            buf_char(out, ',');
+        }
+        buf_json_str(out, key);
+        buf_char(out, ':');
+    } else {
+        buf_str(out, key);
+        buf_char(out, ',');
+    }
+
+    record->count ++;
+}
+
+/* Add string field to record. A NULL value is shown as '-' in text mode. */
+static
+void record_str(
+    console_buf_t *out,
+    console_record_t *record,
+    const char *label,
+    const char *key,
+    const char *value,
+    bool brackets)
+{
+    record_key(out, record, label, key);
+
+    if (record->format == ConsoleText) {
+        if (!value) {
+            buf_char(out, '-');
+        } else if (brackets) {
+            buf_char(out, '[');
+            buf_str(out, value);
+            buf_char(out, ']');
+        } else {
+            buf_str(out, value);
+        }
+        buf_char(out, '\n');
+    } else if (record->format == ConsoleJson) {
+        if (value) {
+            buf_json_str(out, value);
+        } else {
+            buf_str(out, "null");
+        }
+    } else {
+        if (value) {
+            buf_csv_str(out, value);
+        }
+        buf_char(out, '\n');
+    }
+}
+
+static
+void record_int(
+    console_buf_t *out,
+    console_record_t *record,
+    const char *label,
+    const char *key,
+    int64_t value)
+{
+    record_key(out, record, label, key);
+    buf_int(out, value);
+    if (record->format != ConsoleJson) {
+        buf_char(out, '\n');
+    }
+}
+
+static
+void record_bool(
+    console_buf_t *out,
+    console_record_t *record,
+    const char *label,
+    const char *key,
+    bool value)
+{
+    record_key(out, record, label, key);
+    buf_str(out, value ? "true" : "false");
+    if (record->format != ConsoleJson) {
+        buf_char(out, '\n');
+    }
+}
+
+static
+void record_double(
+    console_buf_t *out,
+    console_record_t *record,
+    const char *label,
+    const char *key,
+    double value)
+{
+    record_key(out, record, label, key);
+    buf_printf(out, "%.2f", value);
+    if (record->format != ConsoleJson) {
+        buf_char(out, '\n');
+    }
+}
+
+static
+const console_field_t entity_fields[] = {
+    {"id", "id", 6},
+    {"name", "name", 20},
+    {"type", "type", 0, true},
+    {NULL}
+};
+
+static
+void print_entity_summary(
+    ecs_world_t *world,
+    console_buf_t *out,
+    console_list_t *list,
+    ecs_entity_t entity,
+    const char *type_expr)
+{
+    const char *name = ecs_get_id(world, entity);
+
+    list_int(out, list, entity == ECS_SINGLETON ? 0 : entity);
+    list_str(out, list, name ? name : "");
+    list_str(out, list, type_expr);
+}
+
+/* End a listing that reached its limit */
+static
+int dump_stop(
+    console_buf_t *out,
+    console_job_t *job)
+{
+    list_end(out, &job->list);
+
+    if (job->list.format == ConsoleText) {
+        buf_str(out, "(type 'next' for more)\n");
+    }
+
+    return 0;
+}
+
+static
+int dump_entities(
+    ecs_world_t *world,
+    ui_thread_t *ctx) 
+{
+    console_job_t *job = &ctx->job;
+    console_cursor_t *cursor = &job->cursor;
+    ecs_table_t *table;
+
+    while ((table = ecs_dbg_get_table(world, cursor->table))) {
+        if (job_filter_table(world, ctx, table)) {
+            ecs_dbg_table_t dbg;
+            ecs_dbg_table(world, table, &dbg);
+
+            const char *type_expr = cache_type_expr(
+                world, &ctx->cache, dbg.type);
+
+            /* Entities may have been deleted since the previous frame */
+            int e = cursor->row;
+            e += job_skip(job, dbg.entities_count - e);
+
+            for (; e < dbg.entities_count; e++) {
+                if (job_limit(ctx)) {
+                    ctx->next.cursor.row = e;
+                    return dump_stop(&ctx->out, job);
+                }
+
+                print_entity_summary(
+                    world, &ctx->out, &job->list, dbg.entities[e], type_expr);
+
+                if (job_expired(job)) {
+                    cursor->row = e + 1;
+                    return CONSOLE_MORE;
+                }
+            }
+        }
+
+        cursor->table ++;
+        cursor->row = 0;
+
+        if (job_expired(job)) {
+            return CONSOLE_MORE;
+        }
+    }
+
+    list_end(&ctx->out, &job->list);
+
+    return 0;
+}
+
+static
+ecs_entity_t parse_entity_id(
+    ecs_world_t *world, 
+    console_cache_t *cache,
+    const char *id) 
+{
+    if (isdigit(id[0])) {
+        return atoi(id);
+    } else {
+        return names_lookup(world, &cache->names, id);
+    }
+}
+
+static
+void print_type_details(
+    ecs_world_t *world,
+    console_buf_t *out,
+    console_record_t *record,
+    console_cache_t *cache,
+    ecs_dbg_table_t *dbg_table)
+{
+    record_str(out, record, "type (shared)", "shared", dbg_table->shared
+        ? cache_type_expr(world, cache, dbg_table->shared) : NULL, true);
+
+    record_str(out, record, "type (container)", "container", 
+        dbg_table->container
+            ? cache_type_expr(world, cache, dbg_table->container) 
+            : NULL, true);
+
+    record_str(out, record, "child of", "child_of", 
+        dbg_table->parent_entities
+            ? cache_type_expr(world, cache, dbg_table->parent_entities) 
+            : NULL, false);
+
+    record_str(out, record, "inherits from", "inherits_from", 
+        dbg_table->base_entities
+            ? cache_type_expr(world, cache, dbg_table->base_entities) 
+            : NULL, false);
+}
+
+static
+int dump_entity(
+    ecs_world_t *world, 
+    console_buf_t *out,
+    console_cache_t *cache,
+    console_format_t format,
+    ecs_entity_t e) 
+{  
+    ecs_dbg_entity_t dbg;
+    ecs_dbg_entity(world, e, &dbg);
+
+    ecs_dbg_table_t dbg_table = {0};
+    if (dbg.table) {
+        ecs_dbg_table(world, dbg.table, &dbg_table);
+    }
+
+    console_record_t record;
+    record_begin(out, &record, format, 24);
+
+    record_int(out, &record, "id", "id", e);
+
+    const char *name = ecs_get_id(world, e);
+    if (name) {
+        record_str(out, &record, "name", "name", name, false);
+    }
+
+    record_str(out, &record, "type (owned)", "type", 
+        cache_type_expr(world, cache, dbg.type), true);
+
+    print_type_details(world, out, &record, cache, &dbg_table);
+
+    record_str(out, &record, "matched with", "matched_with", 
+        cache_matched_with(world, cache, dbg.table, &dbg_table), false);
+
+    record_bool(out, &record, "is watched", "is_watched", dbg.is_watched);
+    record_int(out, &record, "row", "row", dbg.row);
+
+    record_end(out, &record);
+
+    return 0;
+}
+
+static
+int parse_type_filter(
+    ecs_world_t *world,
+    const char *args,
+    ecs_type_filter_t *filter_out) 
+{
+    /* Split [A, !B] into an include and an exclude expression */
+    size_t len = strlen(args);
+    char *include = ecs_os_calloc(1, len + 1), *iptr = include;
+    char *exclude = ecs_os_calloc(1, len + 1), *eptr = exclude;
+    const char *ptr = args + 1, *end = args + len - 1;
+
+    while (ptr < end) {
+        while (ptr < end && (isspace(*ptr) || *ptr == ',')) {
+            ptr ++;
+        }
+
+        const char *elem = ptr;
+        while (ptr < end && *ptr != ',') {
+            ptr ++;
+        }
+
+        if (elem == ptr) {
+            break;
+        }
+
+        bool is_exclude = elem[0] == '!';
+        char *base = is_exclude ? exclude : include;
+        char **dst = is_exclude ? &eptr : &iptr;
+        if (is_exclude) {
+            elem ++;
+        }
+
+        if (*dst != base) {
+            *((*dst) ++) = ',';
+        }
+
+        memcpy(*dst, elem, ptr - elem);
+        *dst += ptr - elem;
+    }
+
+    int result = 0;
+    if (include[0]) {
+        filter_out->include = ecs_expr_to_type(world, include);
+        result |= !filter_out->include;
+    }
+    if (exclude[0]) {
+        filter_out->exclude = ecs_expr_to_type(world, exclude);
+        result |= !filter_out->exclude;
+    }
+
+    ecs_os_free(include);
+    ecs_os_free(exclude);
+
+    return result ? -1 : 0;
+}
+
+static
+int cmd_entity(
+    ecs_world_t *world, 
+    const char *args,
+    ui_thread_t *ctx) 
+{
+    if (!args[0]) {
+        job_start(ctx, dump_entities, NULL);
+        list_begin(&ctx->out, &ctx->job.list, entity_fields, ctx->format);
+    } else if (args[0] == '[') {
+        ecs_type_filter_t filter = {0};
+
+        if (parse_type_filter(world, args, &filter)) {
+            return -1;
+        }
+
+        job_start(ctx, dump_entities, &filter);
+        list_begin(&ctx->out, &ctx->job.list, entity_fields, ctx->format);
+    } else {
+        ecs_entity_t e = parse_entity_id(world, &ctx->cache, args);
+        if (!e) {
+            return -1;
+        }
+
+        return dump_entity(world, &ctx->out, &ctx->cache, ctx->format, e);
+    }
+
+    return 0;
+}
+
+static
+const console_field_t table_fields[] = {
+    {"id", "id", 4},
+    {"type", "type", 64, true},
+    {"entities", "entities", 12},
+    {"matched with", "matched_with", 0, false, "-"},
+    {NULL}
+};
+
+static
+void print_table_summary(
+    ecs_world_t *world,
+    console_buf_t *out,
+    console_list_t *list,
+    console_cache_t *cache,
+    ecs_table_t *table)
+{
+    ecs_dbg_table_t dbg;
+    ecs_dbg_table(world, table, &dbg);
+
+    list_str(out, list, cache_type_expr(world, cache, dbg.type));
+    list_int(out, list, dbg.entities_count);
+    list_str(out, list, cache_matched_with(world, cache, table, &dbg));
+}
+
+static
+int dump_tables(
+    ecs_world_t *world,
+    ui_thread_t *ctx) 
+{
+    console_job_t *job = &ctx->job;
+    console_cursor_t *cursor = &job->cursor;
+    ecs_table_t *table;
+
+    while ((table = ecs_dbg_get_table(world, cursor->table))) {
+        if (job_filter_table(world, ctx, table) && !job_skip(job, 1)) {
+            if (job_limit(ctx)) {
+                return dump_stop(&ctx->out, job);
+            }
+
+            list_int(&ctx->out, &job->list, cursor->table + 1);
+            print_table_summary(
+                world, &ctx->out, &job->list, &ctx->cache, table);
+        }
+
+        cursor->table ++;
+
+        if (job_expired(job)) {
+            return CONSOLE_MORE;
+        }
+    }
+
+    list_end(&ctx->out, &job->list);
+
+    return 0;
+}
+
+static
+int dump_table(
+    ecs_world_t *world,
+    console_buf_t *out,
+    console_cache_t *cache,
+    console_format_t format,
+    uint32_t id)
+{
+    ecs_table_t *table = ecs_dbg_get_table(world, id - 1);
+    if (!table) {
+        return -1;
+    }
+
+    ecs_dbg_table_t dbg;
+    ecs_dbg_table(world, table, &dbg);
+
+    console_record_t record;
+    record_begin(out, &record, format, 24);
+
+    record_str(out, &record, "type (owned)", "type", 
+        cache_type_expr(world, cache, dbg.type), true);
+
+    print_type_details(world, out, &record, cache, &dbg);
+
+    record_int(out, &record, "entities", "entities", dbg.entities_count);
+
+    record_str(out, &record, "matched with", "matched_with", 
+        cache_matched_with(world, cache, table, &dbg), false);
+
+    record_end(out, &record);
+
+    return 0;
+}
+
+static
+int cmd_table(
+    ecs_world_t *world, 
+    const char *args,
+    ui_thread_t *ctx) 
+{
+    if (!args[0]) {
+        job_start(ctx, dump_tables, NULL);
+        list_begin(&ctx->out, &ctx->job.list, table_fields, ctx->format);
+    } else if (args[0] == '[') {
+        ecs_type_filter_t filter = {0};
+
+        if (parse_type_filter(world, args, &filter)) {
+            return -1;
+        }
+
+        job_start(ctx, dump_tables, &filter);
+        list_begin(&ctx->out, &ctx->job.list, table_fields, ctx->format);
+    } else {
+        if (isdigit(args[0])) {
+            int id = atoi(args);
+            dump_table(world, &ctx->out, &ctx->cache, ctx->format, id);
+        } else {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static
+int32_t ids_find(
+    ecs_entity_t *ids,
+    int32_t count,
+    ecs_entity_t id)
+{
+    int32_t i;
+    for (i = 0; i < count; i ++) {
+        if (ids[i] == id) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static
+void ids_append(
+    ecs_entity_t **ids,
+    int32_t *count,
+    ecs_entity_t id)
+{
+    *ids = ecs_os_realloc(*ids, sizeof(ecs_entity_t) * (*count + 1));
+    (*ids)[(*count) ++] = id;
+}
+
+static
+void ids_remove(
+    ecs_entity_t *ids,
+    int32_t *count,
+    int32_t index)
+{
+    ids[index] = ids[-- (*count)];
+}
+
+static
+ecs_type_t ids_to_type(
+    ecs_world_t *world,
+    ecs_entity_t *ids,
+    int32_t count)
+{
+    ecs_type_t type = NULL;
+    int32_t i;
+    for (i = 0; i < count; i ++) {
+        type = ecs_type_merge(
+            world, type, ecs_type_from_entity(world, ids[i]), NULL);
+    }
+
+    return type;
+}
+
+static
+size_t component_size(
+    ecs_world_t *world,
+    ecs_entity_t component)
+{
+    EcsComponent *ptr = ecs_get_ptr(world, component, EcsComponent);
+    if (!ptr) {
+        return 0;
+    }
+
+    return ptr->size;
+}
+
+static
+const console_field_t system_fields[] = {
+    {"id", "id", 4},
+    {"name", "name", 20},
+    {"tables matched", "tables_matched", 18},
+    {"entities matched", "entities_matched", 0},
+    {NULL}
+};
+
+static
+int print_system_summary(
+    ecs_world_t *world,
+    console_buf_t *out,
+    console_list_t *list,
+    ecs_entity_t system)
+{
+    ecs_dbg_col_system_t dbg;
+    if (ecs_dbg_col_system(world, system, &dbg)) {
+        return -1;
+    }
+    
+    const char *name = ecs_get_id(world, system);
+
+    list_int(out, list, system);
+    list_str(out, list, name ? name : "");
+    list_int(out, list, dbg.active_table_count + dbg.inactive_table_count);
+    list_int(out, list, dbg.entities_matched_count);
+    
+    return 0;
+}
+
+static
+int dump_system(
+    ecs_world_t *world,
+    console_buf_t *out,
+    console_format_t format,
+    ecs_entity_t system)
+{
+    ecs_dbg_col_system_t dbg;
+    if (ecs_dbg_col_system(world, system, &dbg)) {
+        return -1;
+    }
+
+    console_record_t record;
+    record_begin(out, &record, format, 32);
+
+    record_int(out, &record, "id", "id", system);
+    record_str(out, &record, "name", "name", ecs_get_id(world, system), false);
+    record_bool(out, &record, "enabled", "enabled", dbg.enabled);
+    record_int(out, &record, "entities matched", "entities_matched", 
+        dbg.entities_matched_count);
+    record_int(out, &record, "active matched", "active_matched", 
+        dbg.active_table_count);
+    record_int(out, &record, "inactive matched", "inactive_matched", 
+        dbg.inactive_table_count);
+
+    record_end(out, &record);
+
+    return 0;
+}
+
+static
+int dump_systems(
+    ecs_world_t *world,
+    ui_thread_t *ctx) 
+{
+    console_job_t *job = &ctx->job;
+    console_cursor_t *cursor = &job->cursor;
+    ecs_table_t *table;
+
+    while ((table = ecs_dbg_get_table(world, cursor->table))) {
+        if (job_filter_table(world, ctx, table)) {
+            ecs_dbg_table_t dbg;
+            ecs_dbg_table(world, table, &dbg);
+
+            int e = cursor->row;
+            e += job_skip(job, dbg.entities_count - e);
+
+            for (; e < dbg.entities_count; e++) {
+                if (job_limit(ctx)) {
+                    ctx->next.cursor.row = e;
+                    return dump_stop(&ctx->out, job);
+                }
+
+                print_system_summary(
+                    world, &ctx->out, &job->list, dbg.entities[e]);
+
+                if (job_expired(job)) {
+                    cursor->row = e + 1;
+                    return CONSOLE_MORE;
+                }
+            }
+        }
+
+        cursor->table ++;
+        cursor->row = 0;
+
+        if (job_expired(job)) {
+            return CONSOLE_MORE;
+        }
+    }
+
+    list_end(&ctx->out, &job->list);
+
+    return 0;
+}
+
+static
+int cmd_system(
+    ecs_world_t *world,
+    const char *args,
+    ui_thread_t *ctx)
+{
+    if (!args[0]) {
+        ecs_type_filter_t filter = {
+            .include = ecs_type(EcsColSystem)
+        };
+
+        job_start(ctx, dump_systems, &filter);
+        list_begin(&ctx->out, &ctx->job.list, system_fields, ctx->format);
+    } else {
+        ecs_entity_t e = parse_entity_id(world, &ctx->cache, args);
+        if (!e) {
+            return -1;
+        }
+
+        return dump_system(world, &ctx->out, ctx->format, e);
+    }
+
+    return 0;
+}
+
+/* Size of a cache line in bytes */
+#define CONSOLE_CACHE_LINE (64)
+
+/* Systems that use less of the cache lines they load than this percentage
+ * are flagged by the layout command */
+#define CONSOLE_LAYOUT_WARN (50)
+
+/* Alignment is not stored with a component, so it is estimated as the
+ * largest power of two up to 8 that divides the size */
+static
+size_t align_estimate(
+    size_t size)
+{
+    size_t align = 1;
+    while (align < 8 && !(size % (align * 2))) {
+        align *= 2;
+    }
+
+    return align;
+}
+
+static
+EcsSystemStats* stats_system(
+    EcsWorldStats *stats,
+    ecs_entity_t system);
+
+/* Components that a system reads from the table of the entity. Not and
+ * optional columns are not read for every entity and are left out, which
+ * requires the signature from the world stats. Components of columns that
+ * are shared, or come from a container, are not streamed per entity and are
+ * left out for tables that don't own them. */
+static
+int32_t layout_components(
+    ecs_world_t *world,
+    ecs_entity_t system,
+    ecs_entity_t **components_out)
+{
+    ecs_entity_t *components = NULL;
+    int32_t column = 1, i, count = 0;
+    ecs_type_t type;
+
+    EcsWorldStats stats = {0};
+    ecs_get_stats(world, &stats);
+
+    EcsSystemStats *system_stats = stats_system(&stats, system);
+    const char *sig = system_stats ? system_stats->signature : NULL;
+
+    while ((type = ecs_dbg_get_column_type(world, system, column ++))) {
+        /* Columns are separated by commas in the signature */
+        if (sig) {
+            while (isspace(*sig)) {
+                sig ++;
+            }
+
+            bool skip = *sig == '!' || *sig == '?';
+            if ((sig = strchr(sig, ','))) {
+                sig ++;
+            }
+
+            if (skip) {
+                continue;
+            }
+        }
+
+        ecs_entity_t *array = ecs_vector_first(type);
+        int32_t type_count = ecs_vector_count(type);
+
+        for (i = 0; i < type_count; i ++) {
+            if (component_size(world, array[i]) && 
+                ids_find(components, count, array[i]) == -1) 
+            {
+                ids_append(&components, &count, array[i]);
+            }
+        }
+    }
+
+    ecs_free_stats(&stats);
+
+    *components_out = components;
+
+    return count;
+}
+
+static
+const console_field_t layout_component_fields[] = {
+    {"component", "component", 24},
+    {"size", "size", 8},
+    {"align", "align", 8},
+    {"per line", "per_line", 10},
+    {"straddles lines", "straddles_lines", 0},
+    {NULL}
+};
+
+static
+const console_field_t layout_table_fields[] = {
+    {"type", "type", 40, true},
+    {"entities", "entities", 10},
+    {"columns", "columns", 9},
+    {"bytes", "bytes", 10},
+    {"lines", "lines", 8},
+    {"used (%)", "used_pct", 0},
+    {NULL}
+};
+
+/* Show how the columns a system reads map onto cache lines. Column arrays
+ * are assumed to start on a cache line, so every column of a table loads at
+ * least one line, however few entities the table has. */
+static
+int cmd_layout(
+    ecs_world_t *world,
+    const char *args,
+    ui_thread_t *ctx)
+{
+    console_buf_t *out = &ctx->out;
+    ecs_entity_t system = parse_entity_id(world, &ctx->cache, args);
+    if (!system) {
+        return -1;
+    }
+
+    ecs_dbg_col_system_t dbg;
+    if (ecs_dbg_col_system(world, system, &dbg)) {
+        return -1;
+    }
+
+    ecs_entity_t *components;
+    int32_t c, t, count = layout_components(world, system, &components);
+
+    console_list_t list;
+    list_begin(out, &list, layout_component_fields, ctx->format);
+
+    for (c = 0; c < count; c ++) {
+        size_t size = component_size(world, components[c]);
+        const char *name = ecs_get_id(world, components[c]);
+
+        list_str(out, &list, name ? name : "");
+        list_int(out, &list, size);
+        list_int(out, &list, align_estimate(size));
+        list_double(out, &list, (double)CONSOLE_CACHE_LINE / size);
+        list_str(out, &list, 
+            (size % CONSOLE_CACHE_LINE) && (CONSOLE_CACHE_LINE % size) 
+            ? "yes" : "no");
+    }
+
+    list_end(out, &list);
+
+    int64_t entities = 0, lines = 0, bytes = 0;
+    int32_t max_columns = 0;
+    ecs_table_t *table;
+
+    list_begin(out, &list, layout_table_fields, ctx->format);
+
+    /* Inactive tables are empty, but are matched and counted as well */
+    for (t = 0; ; t ++) {
+        if (t < dbg.active_table_count) {
+            table = ecs_dbg_get_active_table(world, &dbg, t);
+        } else {
+            table = ecs_dbg_get_inactive_table(
+                world, &dbg, t - dbg.active_table_count);
+        }
+
+        if (!table) {
+            break;
+        }
+
+        ecs_dbg_table_t table_dbg;
+        ecs_dbg_table(world, table, &table_dbg);
+
+        int64_t table_bytes = 0, table_lines = 0;
+        int32_t columns = 0, n = table_dbg.entities_count;
+
+        for (c = 0; c < count; c ++) {
+            if (!ecs_type_has_entity(world, table_dbg.type, components[c])) {
+                continue;
+            }
+
+            int64_t column_bytes = component_size(world, components[c]) * n;
+            table_bytes += column_bytes;
+            table_lines += (column_bytes + CONSOLE_CACHE_LINE - 1) / 
+                CONSOLE_CACHE_LINE;
+            columns ++;
+        }
+
+        if (columns > max_columns) {
+            max_columns = columns;
+        }
+
+        entities += n;
+        bytes += table_bytes;
+        lines += table_lines;
+
+        list_str(out, &list, 
+            cache_type_expr(world, &ctx->cache, table_dbg.type));
+        list_int(out, &list, n);
+        list_int(out, &list, columns);
+        list_int(out, &list, table_bytes);
+        list_int(out, &list, table_lines);
+        list_double(out, &list, table_lines 
+            ? 100.0 * table_bytes / (table_lines * CONSOLE_CACHE_LINE) : 0);
+    }
+
+    list_end(out, &list);
+
+    double used = lines ? 100.0 * bytes / (lines * CONSOLE_CACHE_LINE) : 100;
+
+    if (ctx->format == ConsoleText) {
+        buf_char(out, '\n');
+    }
+
+    console_record_t record;
+    record_begin(out, &record, ctx->format, 32);
+    record_str(out, &record, "system", "system", ecs_get_id(world, system), false);
+    record_int(out, &record, "tables", "tables", t);
+    record_int(out, &record, "entities", "entities", entities);
+    record_double(out, &record, "entities per table", "entities_per_table", 
+        t ? (double)entities / t : 0);
+    record_int(out, &record, "bytes per entity", "bytes_per_entity", 
+        entities ? bytes / entities : 0);
+    record_int(out, &record, "cache lines per run", "cache_lines", lines);
+    record_double(out, &record, "cache line bytes used (%)", "used_pct", used);
+    record_end(out, &record);
+
+    if (ctx->format == ConsoleText && max_columns > 1 && 
+        used < CONSOLE_LAYOUT_WARN) 
+    {
+        buf_printf(out, "warning: system reads %d columns from tables with "
+            "%.1f entities on average, %.0f%% of loaded cache line bytes are used\n",
+            max_columns, t ? (double)entities / t : 0, used);
+    }
+
+    ecs_os_free(components);
+
+    return 0;
+}
+
+/* Pipeline phases, in the order in which they run */
+static
+const struct {
+    const char *name;
+    size_t offset;
+} console_phases[] = {
+    {"OnLoad", offsetof(EcsWorldStats, on_load_systems)},
+    {"PostLoad", offsetof(EcsWorldStats, post_load_systems)},
+    {"PreUpdate", offsetof(EcsWorldStats, pre_update_systems)},
+    {"OnUpdate", offsetof(EcsWorldStats, on_update_systems)},
+    {"OnValidate", offsetof(EcsWorldStats, on_validate_systems)},
+    {"PostUpdate", offsetof(EcsWorldStats, post_update_systems)},
+    {"PreStore", offsetof(EcsWorldStats, pre_store_systems)},
+    {"OnStore", offsetof(EcsWorldStats, on_store_systems)},
+    {NULL}
+};
+
+/* Return the EcsSystemStats vector of a phase */
+static
+ecs_vector_t* stats_phase(
+    EcsWorldStats *stats,
+    int32_t phase)
+{
+    return *(ecs_vector_t**)((char*)stats + console_phases[phase].offset);
+}
+
+/* Find the stats of a system in the phases and the other system lists */
+static
+EcsSystemStats* stats_system(
+    EcsWorldStats *stats,
+    ecs_entity_t system)
+{
+    ecs_vector_t *lists[CONSOLE_PHASE_COUNT + 3] = {
+        stats->task_systems, stats->inactive_systems, stats->on_demand_systems
+    };
+
+    int32_t i, l;
+    for (l = 0; l < CONSOLE_PHASE_COUNT; l ++) {
+        lists[l + 3] = stats_phase(stats, l);
+    }
+
+    for (l = 0; l < CONSOLE_PHASE_COUNT + 3; l ++) {
+        EcsSystemStats *buffer = ecs_vector_first(lists[l]);
+        int32_t count = ecs_vector_count(lists[l]);
+        for (i = 0; i < count; i ++) {
+            if (buffer[i].handle == system) {
+                return &buffer[i];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* System time measurement is shared by commands. It is enabled by the first
+ * command that needs it, and restored when the last command is done. */
+static
+void measure_acquire(
+    ecs_world_t *world,
+    ui_thread_t *ctx)
+{
+    if (!ctx->measure_refs ++) {
+        EcsWorldStats stats = {0};
+        ecs_get_stats(world, &stats);
+        ctx->measure_was_on = stats.system_profiling;
+        ecs_free_stats(&stats);
+
+        ecs_measure_system_time(world, true);
+    }
+}
+
+static
+void measure_release(
+    ecs_world_t *world,
+    ui_thread_t *ctx)
+{
+    if (!-- ctx->measure_refs && !ctx->measure_was_on) {
+        ecs_measure_system_time(world, false);
+    }
+}
+
+static
+int profile_compare_system(
+    const void *p1,
+    const void *p2)
+{
+    ecs_entity_t e1 = ((const console_profile_system_t*)p1)->system;
+    ecs_entity_t e2 = ((const console_profile_system_t*)p2)->system;
+    return (e1 > e2) - (e1 < e2);
+}
+
+static
+console_profile_system_t* profile_find(
+    console_profile_t *profile,
+    ecs_entity_t system)
+{
+    console_profile_system_t key = { .system = system };
+    return bsearch(&key, profile->systems, profile->count, 
+        sizeof(console_profile_system_t), profile_compare_system);
+}
+
+static
+void profile_free(
+    console_profile_t *profile)
+{
+    int32_t i;
+    for (i = 0; i < profile->count; i ++) {
+        ecs_os_free(profile->systems[i].samples);
+    }
+
+    ecs_os_free(profile->systems);
+    profile->systems = NULL;
+    profile->count = 0;
+}
+
+/* Record the time each system spent since the previous sample. Systems only
+ * get a sample in frames in which they ran. */
+static
+void profile_sample(
+    console_profile_t *profile,
+    EcsWorldStats *stats)
+{
+    int32_t p;
+    for (p = 0; console_phases[p].name; p ++) {
+        ecs_vector_t *systems = stats_phase(stats, p);
+        EcsSystemStats *buffer = ecs_vector_first(systems);
+        uint32_t i, count = ecs_vector_count(systems);
+
+        for (i = 0; i < count; i ++) {
+            console_profile_system_t *sys = profile_find(
+                profile, buffer[i].handle);
+
+            /* System was created while profiling */
+            if (!sys) {
+                continue;
+            }
+
+            double delta = buffer[i].time_spent - sys->time_spent;
+            sys->time_spent = buffer[i].time_spent;
+            sys->entities = buffer[i].entities_matched;
+
+            if (delta > 0) {
+                sys->samples[sys->calls % profile->frames] = delta;
+                sys->calls ++;
+            }
+        }
+    }
+}
+
+typedef struct console_profile_result_t {
+    const char *name;
+    int32_t calls;
+    double total;
+    double min;
+    double max;
+    double p50;
+    double p99;
+    double entities_per_us;
+} console_profile_result_t;
+
+static
+int profile_compare_float(
+    const void *p1,
+    const void *p2)
+{
+    float f1 = *(const float*)p1, f2 = *(const float*)p2;
+    return (f1 > f2) - (f1 < f2);
+}
+
+static
+int profile_compare_result(
+    const void *p1,
+    const void *p2)
+{
+    double t1 = ((const console_profile_result_t*)p1)->total;
+    double t2 = ((const console_profile_result_t*)p2)->total;
+    return (t1 < t2) - (t1 > t2);
+}
+
+static
+const console_field_t profile_fields[] = {
+    {"system", "system", 20},
+    {"calls", "calls", 8},
+    {"total (ms)", "total_ms", 12},
+    {"avg (us)", "avg_us", 10},
+    {"min (us)", "min_us", 10},
+    {"p50 (us)", "p50_us", 10},
+    {"p99 (us)", "p99_us", 10},
+    {"max (us)", "max_us", 10},
+    {"entities/us", "entities_per_us", 0},
+    {NULL}
+};
+
+static
+void profile_report(
+    console_buf_t *out,
+    console_profile_t *profile,
+    console_format_t format)
+{
+    console_profile_result_t *results = ecs_os_calloc(
+        profile->count + 1, sizeof(console_profile_result_t));
+    float *sorted = ecs_os_malloc(profile->frames * sizeof(float));
+    int32_t i, count = 0;
+
+    for (i = 0; i < profile->count; i ++) {
+        console_profile_system_t *sys = &profile->systems[i];
+        int32_t s, calls = sys->calls;
+        if (!calls) {
+            continue;
+        }
+
+        if (calls > profile->frames) {
+            calls = profile->frames;
+        }
+
+        memcpy(sorted, sys->samples, calls * sizeof(float));
+        qsort(sorted, calls, sizeof(float), profile_compare_float);
+
+        console_profile_result_t *r = &results[count ++];
+        r->name = sys->name;
+        r->calls = sys->calls;
+        for (s = 0; s < calls; s ++) {
+            r->total += sorted[s];
+        }
+        r->min = sorted[0];
+        r->max = sorted[calls - 1];
+        r->p50 = sorted[calls / 2];
+        r->p99 = sorted[(calls * 99) / 100];
+        r->entities_per_us = r->total 
+            ? ((double)sys->entities * calls) / (r->total * 1000000.0) 
+            : 0;
+    }
+
+    qsort(results, count, sizeof(console_profile_result_t), 
+        profile_compare_result);
+
+    console_list_t list;
+    list_begin(out, &list, profile_fields, format);
+
+    for (i = 0; i < count; i ++) {
+        console_profile_result_t *r = &results[i];
+        int32_t calls = r->calls < profile->frames ? r->calls : profile->frames;
+
+        list_str(out, &list, r->name);
+        list_int(out, &list, r->calls);
+        list_double(out, &list, r->total * 1000.0);
+        list_double(out, &list, (r->total / calls) * 1000000.0);
+        list_double(out, &list, r->min * 1000000.0);
+        list_double(out, &list, r->p50 * 1000000.0);
+        list_double(out, &list, r->p99 * 1000000.0);
+        list_double(out, &list, r->max * 1000000.0);
+        list_double(out, &list, r->entities_per_us);
+    }
+
+    list_end(out, &list);
+
+    ecs_os_free(sorted);
+    ecs_os_free(results);
+}
+
+/* Runs once per frame until the requested number of frames is profiled */
+static
+int profile_step(
+    ecs_world_t *world,
+    ui_thread_t *ctx)
+{
+    console_profile_t *profile = &ctx->profile;
+    EcsWorldStats stats = {0};
+    ecs_get_stats(world, &stats);
+
+    /* Don't sample twice in the same frame */
+    if (stats.tick_count != profile->tick) {
+        profile->tick = stats.tick_count;
+        profile_sample(profile, &stats);
+        profile->sampled ++;
+    }
+
+    ecs_free_stats(&stats);
+
+    if (profile->sampled < profile->frames) {
+        return CONSOLE_MORE;
+    }
+
+    measure_release(world, ctx);
+    profile->measuring = false;
+
+    profile_report(&ctx->out, profile, ctx->job.list.format);
+
+    return 0;
+}
+
+static
+int cmd_profile(
+    ecs_world_t *world,
+    const char *args,
+    ui_thread_t *ctx)
+{
+    console_profile_t *profile = &ctx->profile;
+    int32_t frames = args[0] ? atoi(args) : 100;
+    if (frames <= 0 || frames > CONSOLE_PROFILE_MAX_FRAMES) {
+        return -1;
+    }
+
+    profile_free(profile);
+
+    EcsWorldStats stats = {0};
+    ecs_get_stats(world, &stats);
+
+    profile->frames = frames;
+    profile->sampled = 0;
+    profile->tick = stats.tick_count;
+
+    int32_t p;
+    for (p = 0; console_phases[p].name; p ++) {
+        profile->count += ecs_vector_count(stats_phase(&stats, p));
+    }
+
+    profile->systems = ecs_os_calloc(
+        profile->count + 1, sizeof(console_profile_system_t));
+
+    int32_t count = 0;
+    for (p = 0; console_phases[p].name; p ++) {
+        ecs_vector_t *systems = stats_phase(&stats, p);
+        EcsSystemStats *buffer = ecs_vector_first(systems);
+        uint32_t i, phase_count = ecs_vector_count(systems);
+
+        for (i = 0; i < phase_count; i ++) {
+            console_profile_system_t *sys = &profile->systems[count ++];
+            sys->system = buffer[i].handle;
+            sys->name = ecs_get_id(world, buffer[i].handle);
+            sys->time_spent = buffer[i].time_spent;
+            sys->samples = ecs_os_malloc(frames * sizeof(float));
+        }
+    }
+
+    qsort(profile->systems, profile->count, sizeof(console_profile_system_t),
+        profile_compare_system);
+
+    ecs_free_stats(&stats);
+
+    /* A profile that is restarted keeps its reference */
+    if (!profile->measuring) {
+        measure_acquire(world, ctx);
+        profile->measuring = true;
+    }
+
+    job_start(ctx, profile_step, NULL);
+    ctx->job.list.format = ctx->format;
+
+    return 0;
+}
+
+/* Copy a whitespace delimited word into word, return pointer after word */
+static
+const char* parse_word(
+    const char *ptr,
+    char *word,
+    size_t size)
+{
+    size_t len = 0;
+
+    while (isspace(*ptr)) {
+        ptr ++;
+    }
+
+    while (*ptr && !isspace(*ptr)) {
+        if (len < size - 1) {
+            word[len ++] = *ptr;
+        }
+        ptr ++;
+    }
+
+    word[len] = '\0';
+
+    return ptr;
+}
+
+static
+int32_t hdr_index(
+    uint64_t value)
+{
+    if (value < CONSOLE_HDR_SUB_COUNT) {
+        return (int32_t)value;
+    }
+
+    int32_t msb = CONSOLE_HDR_SUB_BITS;
+    while (value >> (msb + 1)) {
+        msb ++;
+    }
+
+    int32_t shift = msb - CONSOLE_HDR_SUB_BITS;
+    int32_t index = (shift + 1) * CONSOLE_HDR_SUB_COUNT + 
+        (int32_t)((value >> shift) - CONSOLE_HDR_SUB_COUNT);
+
+    if (index >= CONSOLE_HDR_BUCKETS) {
+        index = CONSOLE_HDR_BUCKETS - 1;
+    }
+
+    return index;
+}
+
+/* Lowest value that is stored in a bucket */
+static
+uint64_t hdr_value(
+    int32_t index)
+{
+    if (index < CONSOLE_HDR_SUB_COUNT) {
+        return index;
+    }
+
+    int32_t shift = index / CONSOLE_HDR_SUB_COUNT - 1;
+    uint64_t sub = index % CONSOLE_HDR_SUB_COUNT + CONSOLE_HDR_SUB_COUNT;
+
+    return sub << shift;
+}
+
+static
+void hdr_record(
+    console_hdr_t *hdr,
+    double seconds)
+{
+    double us = seconds * 1000000.0;
+    hdr->counts[hdr_index((uint64_t)us)] ++;
+    hdr->total ++;
+
+    if (us > hdr->max) {
+        hdr->max = us;
+    }
+}
+
+/* Return value at quantile q of two combined histograms, in microseconds */
+static
+double hdr_quantile(
+    console_hdr_t *h1,
+    console_hdr_t *h2,
+    double q)
+{
+    uint64_t total = h1->total + h2->total;
+    if (!total) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(q * total), seen = 0;
+    if (rank >= total) {
+        rank = total - 1;
+    }
+
+    int32_t i;
+    for (i = 0; i < CONSOLE_HDR_BUCKETS; i ++) {
+        seen += h1->counts[i] + h2->counts[i];
+        if (seen > rank) {
+            /* Middle of the bucket */
+            return (hdr_value(i) + hdr_value(i + 1)) / 2.0;
+        }
+    }
+
+    return hdr_value(CONSOLE_HDR_BUCKETS - 1);
+}
+
+/* Total time spent by the systems of a phase */
+static
+double phase_spent(
+    EcsWorldStats *stats,
+    int32_t phase)
+{
+    ecs_vector_t *systems = stats_phase(stats, phase);
+    EcsSystemStats *buffer = ecs_vector_first(systems);
+    uint32_t i, count = ecs_vector_count(systems);
+    double spent = 0;
+
+    for (i = 0; i < count; i ++) {
+        spent += buffer[i].time_spent;
+    }
+
+    return spent;
+}
+
+/* Called every frame from EcsRunConsole. Without phase times this only
+ * updates a few counters, so it can be left on in production. */
+static
+void frame_record(
+    ecs_world_t *world,
+    console_frames_t *frames,
+    float delta_time)
+{
+    float *times = frames->times[frames->count % CONSOLE_FRAME_WINDOW];
+    memset(times, 0, sizeof(float) * (CONSOLE_PHASE_COUNT + 1));
+
+    if (frames->recorded == CONSOLE_FRAME_WINDOW) {
+        frames->current = !frames->current;
+        frames->recorded = 0;
+        memset(frames->hist[frames->current], 0, 
+            sizeof(frames->hist[frames->current]));
+    }
+
+    console_hdr_t *hist = frames->hist[frames->current];
+    times[0] = delta_time;
+    hdr_record(&hist[0], delta_time);
+
+    if (frames->phases) {
+        EcsWorldStats stats = {0};
+        ecs_get_stats(world, &stats);
+
+        int32_t p;
+        for (p = 0; p < CONSOLE_PHASE_COUNT; p ++) {
+            double spent = phase_spent(&stats, p);
+
+            /* Systems that are deleted can make the total go down */
+            double delta = spent - frames->phase_spent[p];
+            frames->phase_spent[p] = spent;
+            if (delta < 0) {
+                delta = 0;
+            }
+
+            times[p + 1] = delta;
+            hdr_record(&hist[p + 1], delta);
+        }
+
+        ecs_free_stats(&stats);
+    }
+
+    frames->recorded ++;
+    frames->count ++;
+}
+
+static
+const console_field_t frame_fields[] = {
+    {"phase", "phase", 12},
+    {"frames", "frames", 10},
+    {"p50 (ms)", "p50_ms", 10},
+    {"p99 (ms)", "p99_ms", 10},
+    {"p99.9 (ms)", "p999_ms", 12},
+    {"max (ms)", "max_ms", 0},
+    {NULL}
+};
+
+static
+void frame_report(
+    console_buf_t *out,
+    console_frames_t *frames,
+    console_format_t format)
+{
+    console_list_t list;
+    list_begin(out, &list, frame_fields, format);
+
+    int32_t p, last = frames->phases ? CONSOLE_PHASE_COUNT : 0;
+    for (p = 0; p <= last; p ++) {
+        console_hdr_t *h1 = &frames->hist[0][p], *h2 = &frames->hist[1][p];
+        double max = h1->max > h2->max ? h1->max : h2->max;
+
+        list_str(out, &list, p ? console_phases[p - 1].name : "frame");
+        list_int(out, &list, h1->total + h2->total);
+        list_double(out, &list, hdr_quantile(h1, h2, 0.5) / 1000.0);
+        list_double(out, &list, hdr_quantile(h1, h2, 0.99) / 1000.0);
+        list_double(out, &list, hdr_quantile(h1, h2, 0.999) / 1000.0);
+        list_double(out, &list, max / 1000.0);
+    }
+
+    list_end(out, &list);
+}
+
+static
+const console_field_t frame_worst_fields[] = {
+    {"frame", "frame", 12},
+    {"time (ms)", "time_ms", 12},
+    {"slowest phase", "slowest_phase", 16},
+    {"phase (ms)", "phase_ms", 0},
+    {NULL}
+};
+
+/* Show the slowest frames that are still in the frame time ring buffer */
+static
+void frame_worst(
+    console_buf_t *out,
+    console_frames_t *frames,
+    console_format_t format,
+    int32_t count)
+{
+    int32_t i, j, stored = frames->count < CONSOLE_FRAME_WINDOW 
+        ? (int32_t)frames->count : CONSOLE_FRAME_WINDOW;
+    int32_t *worst = ecs_os_malloc(sizeof(int32_t) * (count + 1));
+    int32_t found = 0;
+
+    /* Insertion into a small sorted array, count is expected to be small */
+    for (i = 0; i < stored; i ++) {
+        float t = frames->times[i][0];
+        for (j = found; j > 0 && frames->times[worst[j - 1]][0] < t; j --) {
+            if (j < count) {
+                worst[j] = worst[j - 1];
+            }
+        }
+        if (j < count) {
+            worst[j] = i;
+            if (found < count) {
+                found ++;
+            }
+        }
+    }
+
+    console_list_t list;
+    list_begin(out, &list, frame_worst_fields, format);
+
+    for (i = 0; i < found; i ++) {
+        float *times = frames->times[worst[i]];
+        int32_t p, slowest = 0;
+        for (p = 1; p <= CONSOLE_PHASE_COUNT; p ++) {
+            if (times[p] > times[slowest]) {
+                slowest = p;
+            }
+        }
+
+        /* Frame number from ring buffer slot */
+        uint64_t frame = frames->count - 1 - 
+            ((frames->count - 1 - worst[i]) % CONSOLE_FRAME_WINDOW);
+
+        list_int(out, &list, (int64_t)frame);
+        list_double(out, &list, times[0] * 1000.0);
+        list_str(out, &list, slowest ? console_phases[slowest - 1].name : NULL);
+        list_double(out, &list, times[slowest] * 1000.0 * (slowest != 0));
+    }
+
+    list_end(out, &list);
+
+    ecs_os_free(worst);
+}
+
+static
+void churn_move(
+    console_churn_t *churn,
+    int32_t from,
+    int32_t to)
+{
+    void **head = map_ensure(&churn->sources, (void*)(uintptr_t)(from + 1));
+    int32_t i = (int32_t)(uintptr_t)*head;
+
+    while (i) {
+        console_churn_pair_t *pair = &churn->pairs[i - 1];
+        if (pair->to == to) {
+            pair->count ++;
+            return;
+        }
+        i = pair->next;
+    }
+
+    if (churn->pair_count == churn->pair_size) {
+        churn->pair_size = churn->pair_size ? churn->pair_size * 2 : 64;
+        churn->pairs = ecs_os_realloc(churn->pairs, 
+            sizeof(console_churn_pair_t) * churn->pair_size);
+    }
+
+    churn->pairs[churn->pair_count] = (console_churn_pair_t){
+        .from = from,
+        .to = to,
+        .next = (int32_t)(uintptr_t)*head,
+        .count = 1
+    };
+
+    *head = (void*)(uintptr_t)(++ churn->pair_count);
+}
+
+static
+int churn_compare_entity(
+    const void *p1,
+    const void *p2)
+{
+    ecs_entity_t e1 = *(const ecs_entity_t*)p1;
+    ecs_entity_t e2 = *(const ecs_entity_t*)p2;
+    return (e1 > e2) - (e1 < e2);
+}
+
+static
+void churn_depart(
+    console_churn_t *churn,
+    ecs_entity_t entity,
+    int32_t index)
+{
+    if (churn->departed_count == churn->departed_size) {
+        churn->departed_size = churn->departed_size 
+            ? churn->departed_size * 2 : 64;
+        churn->departed = ecs_os_realloc(churn->departed, 
+            sizeof(console_churn_departed_t) * churn->departed_size);
+    }
+
+    churn->departed[churn->departed_count ++] = (console_churn_departed_t){
+        .entity = entity,
+        .table = index,
+        .cycle = churn->cycle
+    };
+}
+
+static
+void churn_check_table(
+    console_churn_t *churn,
+    ecs_dbg_table_t *dbg,
+    int32_t index)
+{
+    console_churn_table_t *table = &churn->tables[index];
+    int32_t i, j, count = dbg->entities_count;
+
+    ecs_entity_t *members = ecs_os_malloc(sizeof(ecs_entity_t) * (count + 1));
+    memcpy(members, dbg->entities, sizeof(ecs_entity_t) * count);
+    qsort(members, count, sizeof(ecs_entity_t), churn_compare_entity);
+
+    for (i = 0; i < count; i ++) {
+        void **slot = map_ensure(&churn->entities, (void*)(uintptr_t)members[i]);
+        int32_t prev = (int32_t)(uintptr_t)*slot;
+
+        if (prev && prev != index + 1) {
+            churn_move(churn, prev - 1, index);
+            churn->moves ++;
+        }
+
+        *slot = (void*)(uintptr_t)(index + 1);
+    }
+
+    /* Entities that are no longer in the table moved to a table that was not
+     * checked yet, or were deleted */
+    for (i = 0, j = 0; i < table->count; i ++) {
+        ecs_entity_t e = table->members[i];
+        while (j < count && members[j] < e) {
+            j ++;
+        }
+
+        if (j < count && members[j] == e) {
+            continue;
+        }
+
+        if (map_get(&churn->entities, (void*)(uintptr_t)e) == 
+            (void*)(uintptr_t)(index + 1)) 
+        {
+            churn_depart(churn, e, index);
+        }
+    }
+
+    ecs_os_free(table->members);
+    table->members = members;
+    table->count = count;
+}
+
+/* Remove entities from the index that left a table a full cycle ago, and
+ * were not found in another table since */
+static
+void churn_prune(
+    console_churn_t *churn)
+{
+    int32_t i, kept = 0;
+    for (i = 0; i < churn->departed_count; i ++) {
+        console_churn_departed_t *d = &churn->departed[i];
+        if (d->cycle + 1 >= churn->cycle) {
+            churn->departed[kept ++] = *d;
+            continue;
+        }
+
+        void *key = (void*)(uintptr_t)d->entity;
+        console_churn_table_t *table = &churn->tables[d->table];
+        if (map_get(&churn->entities, key) == (void*)(uintptr_t)(d->table + 1) &&
+            !bsearch(&d->entity, table->members, table->count, 
+                sizeof(ecs_entity_t), churn_compare_entity))
+        {
+            map_remove(&churn->entities, key);
+        }
+    }
+
+    churn->departed_count = kept;
+}
+
+/* Visit a table, return the number of entities checked */
+static
+int32_t churn_visit(
+    ecs_world_t *world,
+    console_churn_t *churn,
+    ecs_table_t *table,
+    int32_t index)
+{
+    if (index >= churn->table_size) {
+        int32_t size = churn->table_size ? churn->table_size * 2 : 64;
+        while (size <= index) {
+            size *= 2;
+        }
+
+        churn->tables = ecs_os_realloc(
+            churn->tables, sizeof(console_churn_table_t) * size);
+        churn->table_size = size;
+    }
+
+    while (churn->table_count <= index) {
+        churn->tables[churn->table_count ++] = (console_churn_table_t){
+            .count = -1
+        };
+    }
+
+    ecs_dbg_table_t dbg;
+    ecs_dbg_table(world, table, &dbg);
+
+    bool sweep = index >= churn->sweep && 
+        index < churn->sweep + CONSOLE_CHURN_SWEEP;
+
+    if (dbg.entities_count != churn->tables[index].count || sweep) {
+        churn_check_table(churn, &dbg, index);
+        return dbg.entities_count;
+    }
+
+    return 0;
+}
+
+/* Called every frame from EcsRunConsole while churn tracking is enabled */
+static
+void churn_record(
+    ecs_world_t *world,
+    console_churn_t *churn)
+{
+    int32_t i = churn->cursor, visited = 0, checked = 0;
+
+    while (visited < CONSOLE_CHURN_TABLES && checked < CONSOLE_CHURN_ENTITIES) {
+        ecs_table_t *table = ecs_dbg_get_table(world, i);
+        if (table) {
+            checked += churn_visit(world, churn, table, i);
+            visited ++;
+            i ++;
+        } else if (i) {
+            /* All tables were visited, start the next cycle */
+            i = 0;
+            churn->cycle ++;
+            churn_prune(churn);
+        } else {
+            break;
+        }
+
+        if (i == churn->cursor) {
+            break;
+        }
+    }
+
+    churn->sweep += CONSOLE_CHURN_SWEEP;
+    if (churn->sweep >= churn->table_count) {
+        churn->sweep = 0;
+    }
+
+    churn->cursor = i;
+    churn->frames ++;
+}
+
+static
+void churn_reset(
+    console_churn_t *churn)
+{
+    int32_t i;
+    for (i = 0; i < churn->table_count; i ++) {
+        ecs_os_free(churn->tables[i].members);
+    }
+
+    map_free(&churn->entities);
+    map_free(&churn->sources);
+    ecs_os_free(churn->tables);
+    ecs_os_free(churn->departed);
+    ecs_os_free(churn->pairs);
+
+    *churn = (console_churn_t){ .enabled = churn->enabled };
+}
+
+static
+int churn_compare(
+    const void *p1,
+    const void *p2)
+{
+    const console_churn_pair_t *pair1 = p1, *pair2 = p2;
+    return (pair1->count < pair2->count) - (pair1->count > pair2->count);
+}
+
+/* Write names of components in type that are not in other */
+static
+char* churn_type_diff(
+    ecs_world_t *world,
+    ecs_type_t type,
+    ecs_type_t other)
+{
+    ecs_entity_t *components = ecs_vector_first(type);
+    int32_t i, count = ecs_vector_count(type);
+    console_buf_t buf = {0};
+
+    for (i = 0; i < count; i ++) {
+        if (other && ecs_type_has_entity(world, other, components[i])) {
+            continue;
+        }
+
+        const char *name = ecs_get_id(world, components[i]);
+        if (buf.count) {
+            buf_str(&buf, ", ");
+        }
+
+        if (name) {
+            buf_str(&buf, name);
+        } else {
+            buf_printf(&buf, "%u", (uint32_t)components[i]);
+        }
+    }
+
+    if (buf.buf) {
+        buf.buf[buf.count] = '\0';
+    }
+
+    return buf.buf;
+}
+
+static
+const console_field_t churn_fields[] = {
+    {"from", "from", 28, true},
+    {"to", "to", 28, true},
+    {"moves", "moves", 10},
+    {"per frame", "per_frame", 11},
+    {"added", "added", 20, true, "-"},
+    {"removed", "removed", 0, true, "-"},
+    {NULL}
+};
+
+static
+void churn_report(
+    ecs_world_t *world,
+    ui_thread_t *ctx)
+{
+    console_churn_t *churn = &ctx->churn;
+    console_buf_t *out = &ctx->out;
+    int32_t i, count = ctx->limit ? ctx->limit : 10;
+
+    if (churn->pair_count) {
+        qsort(churn->pairs, churn->pair_count, sizeof(console_churn_pair_t), 
+            churn_compare);
+    }
+
+    /* Sorting invalidates the chains, rebuild them */
+    map_free(&churn->sources);
+    for (i = 0; i < churn->pair_count; i ++) {
+        console_churn_pair_t *pair = &churn->pairs[i];
+        void **head = map_ensure(
+            &churn->sources, (void*)(uintptr_t)(pair->from + 1));
+        pair->next = (int32_t)(uintptr_t)*head;
+        *head = (void*)(uintptr_t)(i + 1);
+    }
+
+    if (ctx->format == ConsoleText) {
+        buf_printf(out, "%llu moves in %llu frames\n", 
+            (unsigned long long)churn->moves, 
+            (unsigned long long)churn->frames);
+    }
+
+    console_list_t list;
+    list_begin(out, &list, churn_fields, ctx->format);
+
+    for (i = 0; i < churn->pair_count && i < count; i ++) {
+        console_churn_pair_t *pair = &churn->pairs[i];
+        ecs_dbg_table_t from, to;
+        ecs_dbg_table(world, ecs_dbg_get_table(world, pair->from), &from);
+        ecs_dbg_table(world, ecs_dbg_get_table(world, pair->to), &to);
+
+        char *added = churn_type_diff(world, to.type, from.type);
+        char *removed = churn_type_diff(world, from.type, to.type);
+
+        list_str(out, &list, cache_type_expr(world, &ctx->cache, from.type));
+        list_str(out, &list, cache_type_expr(world, &ctx->cache, to.type));
+        list_int(out, &list, pair->count);
+        list_double(out, &list, churn->frames 
+            ? (double)pair->count / churn->frames : 0);
+        list_str(out, &list, added);
+        list_str(out, &list, removed);
+
+        ecs_os_free(added);
+        ecs_os_free(removed);
+    }
+
+    list_end(out, &list);
+}
+
+static
+int cmd_churn(
+    ecs_world_t *world,
+    const char *args,
+    ui_thread_t *ctx)
+{
+    char arg[32];
+    parse_word(args, arg, sizeof(arg));
+
+    if (!arg[0]) {
+        if (!ctx->churn.enabled && !ctx->churn.frames) {
+            buf_printf(&ctx->out, "churn tracking is off, enable with 'churn on'\n");
+            return -1;
+        }
+
+        churn_report(world, ctx);
+    } else if (!strcmp(arg, "on")) {
+        ctx->churn.enabled = true;
+    } else if (!strcmp(arg, "off")) {
+        ctx->churn.enabled = false;
+    } else if (!strcmp(arg, "reset")) {
+        churn_reset(&ctx->churn);
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+static
+int cmd_frame(
+    ecs_world_t *world,
+    const char *args,
+    ui_thread_t *ctx)
+{
+    console_frames_t *frames = ctx->frames;
+    char arg[32];
+    args = parse_word(args, arg, sizeof(arg));
+
+    if (!arg[0]) {
+        frame_report(&ctx->out, frames, ctx->format);
+    } else if (!strcmp(arg, "worst")) {
+        int32_t count = atoi(args);
+        frame_worst(&ctx->out, frames, ctx->format, count > 0 ? count : 10);
+    } else if (!strcmp(arg, "phases")) {
+        parse_word(args, arg, sizeof(arg));
+        if (!strcmp(arg, "on")) {
+            /* Phase times are computed from system times */
+            if (!frames->phases) {
+                measure_acquire(world, ctx);
+                frames->phases = true;
+            }
+
+            /* Start from the current totals, so that the time spent before
+             * is not recorded as one frame */
+            EcsWorldStats stats = {0};
+            ecs_get_stats(world, &stats);
+
+            int32_t p;
+            for (p = 0; p < CONSOLE_PHASE_COUNT; p ++) {
+                frames->phase_spent[p] = phase_spent(&stats, p);
+            }
+
+            ecs_free_stats(&stats);
+        } else if (!strcmp(arg, "off")) {
+            if (frames->phases) {
+                measure_release(world, ctx);
+                frames->phases = false;
+            }
+        } else {
+            return -1;
+        }
+
+        memset(frames->hist, 0, sizeof(frames->hist));
+        frames->recorded = 0;
+    } else if (!strcmp(arg, "reset")) {
+        memset(frames->hist, 0, sizeof(frames->hist));
+        frames->recorded = 0;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Describe why an entity or table did not match with a system */
+static
+void print_match_failure(
+    console_buf_t *out,
+    ecs_dbg_match_failure_t *failure_info,
+    const char *system_name,
+    const char *type_expr)
+{
+    switch(failure_info->reason) {
+    case EcsMatchOk:
+        break;
+    case EcsMatchNotASystem:
+        buf_printf(out, "entity '%s' is not a system", system_name);
+        break;
+    case EcsMatchSystemIsATask:
+        buf_printf(out, "system is a task");
+        break;
+    case EcsMatchEntityIsDisabled:
+        buf_printf(out, "entity is disabled");
+        break;
+    case EcsMatchEntityIsPrefab:
+        buf_printf(out, "entity is a prefab");
+        break;
+    case EcsMatchFromSelf:
+        buf_printf(out, "[%s] missing (owned or shared)", type_expr);
+        break;
+    case EcsMatchFromOwned:
+        buf_printf(out, "[%s] missing (owned)", type_expr);
+        break;
+    case EcsMatchFromShared:
+        buf_printf(out, "[%s] missing (shared)", type_expr);
+        break;
+    case EcsMatchFromContainer:
+        buf_printf(out, "[%s] missing (container)", type_expr);
+        break;
+    case EcsMatchFromEntity:
+        buf_printf(out, 
+            "[%s] missing (from entity, system will never run!)", 
+            type_expr);
+        break;
+    case EcsMatchOrFromSelf:
+        buf_printf(out, "[%s] missing in OR expression (owned or shared)", type_expr);
+        break;
+    case EcsMatchOrFromContainer:
+        buf_printf(out, "[%s] missing in OR expression (from container)", type_expr);
+        break;
+    case EcsMatchNotFromSelf:
+        buf_printf(out, "has [%s] from NOT expression (owned or shared)", type_expr);
+        break;
+    case EcsMatchNotFromOwned:
+        buf_printf(out, "has [%s] in NOT expression (owned)", type_expr);
+        break;
+    case EcsMatchNotFromShared:
+        buf_printf(out, "has [%s] in NOT expression (shared)", type_expr);
+        break;
+    case EcsMatchNotFromContainer:
+        buf_printf(out, "has [%s] in NOT expression (from container)", type_expr);
+        break;
+    }
+}
+
+/* Parse a [type] argument into a filter, return pointer after argument. The
+ * filter may have no include, in which case it matches all tables that do
+ * not have an excluded component. */
+static
+const char* parse_filter_arg(
+    ecs_world_t *world,
+    const char *args,
+    ecs_type_filter_t *filter)
+{
+    const char *end = strchr(args, ']');
+    if (args[0] != '[' || !end) {
+        return NULL;
+    }
+
+    char *expr = ecs_os_malloc(end - args + 2);
+    memcpy(expr, args, end - args + 1);
+    expr[end - args + 1] = '\0';
+
+    int result = parse_type_filter(world, expr, filter);
+    ecs_os_free(expr);
+    if (result) {
+        return NULL;
+    }
+
+    end ++;
+    while (isspace(*end)) {
+        end ++;
+    }
+
+    return end;
+}
+
+/* Parse a component or [type] argument */
+static
+ecs_type_t parse_type_arg(
+    ecs_world_t *world,
+    console_cache_t *cache,
+    const char *arg)
+{
+    if (arg[0] == '[') {
+        ecs_type_filter_t filter = {0};
+        if (parse_type_filter(world, arg, &filter)) {
+            return NULL;
+        }
+
+        return filter.include;
+    }
+
+    ecs_entity_t component = parse_entity_id(world, cache, arg);
+    if (!component) {
+        return NULL;
+    }
+
+    return ecs_type_from_entity(world, component);
+}
+
+/* Tables that fail to match a system for the same reason */
+typedef struct console_match_group_t {
+    ecs_match_failure_reason_t reason;
+    int32_t column;
+    int32_t tables;
+    int32_t entities;
+} console_match_group_t;
+
+static
+const console_field_t match_group_fields[] = {
+    {"column", "column", 8},
+    {"reason", "reason", 56},
+    {"tables", "tables", 8},
+    {"entities", "entities", 0},
+    {NULL}
+};
+
+/* Explain why tables do not match with a system. The entities in a table
+ * have the same components, so one entity is evaluated per table. */
+static
+int cmd_match_tables(
+    ecs_world_t *world,
+    console_buf_t *out,
+    console_cache_t *cache,
+    console_format_t format,
+    const char *args)
+{
+    ecs_type_filter_t filter = {0};
+    bool has_filter = args[0] == '[';
+    const char *ptr;
+
+    if (has_filter) {
+        if (!(ptr = parse_filter_arg(world, args, &filter))) {
+            return -1;
+        }
+    } else {
+        ptr = args + 1;
+        while (isspace(*ptr)) {
+            ptr ++;
+        }
+    }
+
+    ecs_entity_t system = parse_entity_id(world, cache, ptr);
+    if (!system) {
+        return -1;
+    }
+
+    ecs_dbg_col_system_t system_dbg;
+    if (ecs_dbg_col_system(world, system, &system_dbg)) {
+        buf_printf(out, "entity '%s' is not a system\n", ptr);
+        return -1;
+    }
+
+    console_match_group_t *groups = NULL;
+    int32_t i = 0, g, group_count = 0, group_size = 0;
+    int32_t tables = 0, entities = 0;
+    ecs_table_t *table;
+
+    while ((table = ecs_dbg_get_table(world, i ++))) {
+        if (has_filter && !ecs_dbg_filter_table(world, table, &filter)) {
+            continue;
+        }
+
+        ecs_dbg_table_t dbg;
+        ecs_dbg_table(world, table, &dbg);
+        if (!dbg.entities_count) {
+            continue;
+        }
+
+        ecs_dbg_match_failure_t failure_info = {0};
+        if (ecs_dbg_match_entity(
+            world, dbg.entities[0], system, &failure_info)) 
+        {
+            tables ++;
+            entities += dbg.entities_count;
+            continue;
+        }
+
+        for (g = 0; g < group_count; g ++) {
+            if (groups[g].reason == failure_info.reason && 
+                groups[g].column == failure_info.column) 
+            {
+                break;
+            }
+        }
+
+        if (g == group_count) {
+            if (group_count == group_size) {
+                group_size = group_size ? group_size * 2 : 8;
+                groups = ecs_os_realloc(
+                    groups, sizeof(console_match_group_t) * group_size);
+            }
+
+            groups[group_count ++] = (console_match_group_t){
+                .reason = failure_info.reason,
+                .column = failure_info.column
+            };
+        }
+
+        groups[g].tables ++;
+        groups[g].entities += dbg.entities_count;
+    }
+
+    if (format == ConsoleText) {
+        buf_printf(out, "%d entities in %d tables match with system '%s'\n", 
+            entities, tables, ptr);
+    }
+
+    console_list_t list;
+    list_begin(out, &list, match_group_fields, format);
+
+    for (g = 0; g < group_count; g ++) {
+        console_match_group_t *group = &groups[g];
+        const char *type_expr = NULL;
+        if (group->column) {
+            type_expr = cache_type_expr(world, cache, 
+                ecs_dbg_get_column_type(world, system, group->column));
+        }
+
+        ecs_dbg_match_failure_t failure_info = {
+            .reason = group->reason,
+            .column = group->column
+        };
+
+        console_buf_t reason = {0};
+        print_match_failure(&reason, &failure_info, ptr, type_expr);
+        buf_char(&reason, '\0');
+
+        list_int(out, &list, group->column);
+        list_str(out, &list, reason.buf);
+        list_int(out, &list, group->tables);
+        list_int(out, &list, group->entities);
+
+        ecs_os_free(reason.buf);
+    }
+
+    list_end(out, &list);
+
+    ecs_os_free(groups);
+
+    return 0;
+}
+
+static
+int cmd_match(
+    ecs_world_t *world,
+    console_buf_t *out,
+    console_cache_t *cache,
+    console_format_t format,
+    const char *args)
+{
+    if (args[0] == '[' || (args[0] == '*' && isspace(args[1]))) {
+        return cmd_match_tables(world, out, cache, format, args);
+    }
+
+    char arg[256];
+    const char *ptr = parse_arg(args, arg);
+    if (!ptr) {
+        return -1;
+    }
+
+    /* Skip whitespace */
+    ptr ++;
+
+    ecs_entity_t e = parse_entity_id(world, cache, arg);
+    if (!e) {
+        return -1;
+    }     
+
+    ecs_entity_t system = parse_entity_id(world, cache, ptr);
+    if (!system) {
+        return -1;
+    }
+
+    const char *system_name = ecs_get_id(world, system);
+    ecs_dbg_match_failure_t failure_info = {0};
+    bool match = ecs_dbg_match_entity(world, e, system, &failure_info);
+
+    const char *type_expr = NULL;
+    if (!match && failure_info.column) {
+        type_expr = cache_type_expr(world, cache, 
+            ecs_dbg_get_column_type(world, system, failure_info.column));
+    }
+
+    if (format == ConsoleText) {
+        if (match) {
+            buf_printf(out, "entitiy '%s' matches with system '%s'\n", 
+                arg, system_name);
+        } else {
+            buf_printf(out, "entity '%s' does not match with system '%s'\n", 
+                arg, system_name);
+
+            if (failure_info.column) {
+                buf_printf(out, "column %d: ", failure_info.column);
+            }
+
+            print_match_failure(out, &failure_info, ptr, type_expr);
+            buf_char(out, '\n');
+        }
+    } else {
+        console_record_t record;
+        record_begin(out, &record, format, 0);
+        record_str(out, &record, "entity", "entity", arg, false);
+        record_str(out, &record, "system", "system", system_name, false);
+        record_bool(out, &record, "match", "match", match);
+
+        if (!match) {
+            console_buf_t reason = {0};
+            print_match_failure(&reason, &failure_info, ptr, type_expr);
+            buf_char(&reason, '\0');
+
+            record_int(out, &record, "column", "column", failure_info.column);
+            record_str(out, &record, "reason", "reason", reason.buf, false);
+            ecs_os_free(reason.buf);
+        }
+
+        record_end(out, &record);
+    }
+
+    return 0;
+}
+
+/* Entities of a table before a bulk operation. All entities in a table have
+ * the same components, so one entity is enough to tell what happens to the
+ * entire table. */
+typedef struct console_bulk_table_t {
+    ecs_entity_t first;
+    int32_t count;
+    bool has;
+    bool has_owned;
+} console_bulk_table_t;
+
+/* Collect the non-empty tables that match a filter */
+static
+console_bulk_table_t* bulk_collect(
+    ecs_world_t *world,
+    ecs_type_filter_t *filter,
+    ecs_type_t type,
+    int32_t *count_out)
+{
+    console_bulk_table_t *result = NULL;
+    ecs_table_t *table;
+    int32_t i = 0, count = 0, size = 0;
+
+    while ((table = ecs_dbg_get_table(world, i ++))) {
+        if (!ecs_dbg_filter_table(world, table, filter)) {
+            continue;
+        }
+
+        ecs_dbg_table_t dbg;
+        ecs_dbg_table(world, table, &dbg);
+        if (!dbg.entities_count) {
+            continue;
+        }
+
+        if (count == size) {
+            size = size ? size * 2 : 32;
+            result = ecs_os_realloc(
+                result, sizeof(console_bulk_table_t) * size);
+        }
+
+        ecs_entity_t e = dbg.entities[0];
+        result[count ++] = (console_bulk_table_t){
+            .first = e,
+            .count = dbg.entities_count,
+            .has = type ? _ecs_has(world, e, type) : false,
+            .has_owned = type ? _ecs_has_owned(world, e, type) : false
+        };
+    }
+
+    *count_out = count;
+
+    return result;
+}
+
+/* Add or remove a component for all entities that match a filter. Flecs
+ * moves the entities of a matching table to the destination table at once,
+ * instead of moving entities one by one. */
+static
+int cmd_add_remove_w_filter(
+    ecs_world_t *world,
+    console_buf_t *out,
+    console_cache_t *cache,
+    const char *args,
+    bool is_remove)
+{
+    /* A filter without include matches almost everything, which is never
+     * what a bulk operation intends */
+    ecs_type_filter_t filter = {0};
+    const char *ptr = parse_filter_arg(world, args, &filter);
+    if (!ptr || !ptr[0] || !filter.include) {
+        return -1;
+    }
+
+    ecs_type_t type = parse_type_arg(world, cache, ptr);
+    if (!type) {
+        return -1;
+    }
+
+    int32_t i, count;
+    console_bulk_table_t *tables = bulk_collect(world, &filter, type, &count);
+
+    if (is_remove) {
+        _ecs_add_remove_w_filter(world, NULL, type, &filter);
+    } else {
+        _ecs_add_remove_w_filter(world, type, NULL, &filter);
+    }
+
+    int32_t changed = 0, overridden = 0, unchanged = 0, inherited = 0;
+    for (i = 0; i < count; i ++) {
+        console_bulk_table_t *table = &tables[i];
+        if (is_remove) {
+            if (!table->has_owned) {
+                if (table->has) {
+                    inherited += table->count;
+                } else {
+                    unchanged += table->count;
+                }
+            } else if (_ecs_has(world, table->first, type)) {
+                overridden += table->count;
+            } else {
+                changed += table->count;
+            }
+        } else {
+            if (table->has_owned) {
+                unchanged += table->count;
+            } else if (table->has) {
+                overridden += table->count;
+            } else {
+                changed += table->count;
+            }
+        }
+    }
+
+    char *type_expr = ecs_type_to_expr(world, type);
+
+    if (!count) {
+        buf_printf(out, "no entities match filter\n");
+    }
+
+    if (is_remove) {
+        if (changed) {
+            buf_printf(out, "removed [%s] from %d entities\n", type_expr, changed);
+        }
+        if (overridden) {
+            buf_printf(out, "removed override [%s] from %d entities\n", type_expr, overridden);
+        }
+        if (inherited) {
+            buf_printf(out, "%d entities do not own [%s]\n", inherited, type_expr);
+        }
+        if (unchanged) {
+            buf_printf(out, "%d entities do not have [%s]\n", unchanged, type_expr);
+        }
+    } else {
+        if (changed) {
+            buf_printf(out, "added [%s] to %d entities\n", type_expr, changed);
+        }
+        if (overridden) {
+            buf_printf(out, "overridden [%s] for %d entities\n", type_expr, overridden);
+        }
+        if (unchanged) {
+            buf_printf(out, "%d entities already have [%s]\n", unchanged, type_expr);
+        }
+    }
+
+    ecs_os_free(type_expr);
+    ecs_os_free(tables);
+
+    return 0;
+}
+
+static
+int cmd_add_remove(
+    ecs_world_t *world,
+    console_buf_t *out,
+    console_cache_t *cache,
+    const char *args,
+    bool is_remove)
+{
+    if (args[0] == '[') {
+        return cmd_add_remove_w_filter(world, out, cache, args, is_remove);
+    }
+
+    char arg[256];
+    const char *ptr = parse_arg(args, arg);
+    if (!ptr) {
+        return -1;
+    }
+
+    /* Skip whitespace */
+    ptr ++;
+
+    ecs_entity_t e = parse_entity_id(world, cache, arg);
+    if (!e) {
+        return -1;
+    }
+
+    ecs_type_t type = parse_type_arg(world, cache, ptr);
+    if (!type) {
+        return -1;
+    }
+
+    char *type_expr = ecs_type_to_expr(world, type);
+
+    if (is_remove) {
+        if (!_ecs_has_owned(world, e, type)) {
+            if (_ecs_has(world, e, type)) {
+                buf_printf(out, "entity '%s' does not own [%s]\n", arg, type_expr);
+            } else {
+                buf_printf(out, "entity '%s' does not have [%s]\n", arg, type_expr);
+            }
+        } else {
+            _ecs_remove(world, e, type);
+            if (_ecs_has(world, e, type)) {
+                buf_printf(out, "removed override [%s] from entity '%s'\n", type_expr, arg);
+            } else {
+                buf_printf(out, "removed [%s] from entity '%s'\n", type_expr, arg);
+            }
+        }
+    } else {
+        if (_ecs_has_owned(world, e, type)) {
+            buf_printf(out, "entity '%s' already has [%s]\n", arg, type_expr);
+        } else {
+            if (_ecs_has(world, e, type)) {
+                _ecs_add(world, e, type);
+                buf_printf(out, "overridden [%s] for entity '%s'\n", type_expr, arg);
+            } else {
+                _ecs_add(world, e, type);
+                buf_printf(out, "added [%s] to entity '%s'\n", type_expr, arg);
+            }
+        }
+    }
+
+    ecs_os_free(type_expr);
+
+    return 0;
+}
+
+/* Delete all entities that match a filter. Flecs clears the storage of a
+ * matching table at once, instead of deleting its entities one by one. */
+static
+int cmd_delete_w_filter(
+    ecs_world_t *world,
+    console_buf_t *out,
+    const char *args)
+{
+    ecs_type_filter_t filter = {0};
+    const char *ptr = parse_filter_arg(world, args, &filter);
+    if (!ptr || ptr[0] || !filter.include) {
+        return -1;
+    }
+
+    int32_t i, count, deleted = 0;
+    console_bulk_table_t *tables = bulk_collect(world, &filter, NULL, &count);
+    for (i = 0; i < count; i ++) {
+        deleted += tables[i].count;
+    }
+
+    ecs_time_t start = {0};
+    ecs_os_get_time(&start);
+
+    ecs_delete_w_filter(world, &filter);
+
+    double t = ecs_time_measure(&start);
+
+    buf_printf(out, "deleted %d entities from %d tables in %.3f ms\n", 
+        deleted, count, t * 1000.0);
+
+    ecs_os_free(tables);
+
+    return 0;
+}
+
+static
+int cmd_delete(
+    ecs_world_t *world,
+    console_buf_t *out,
+    console_cache_t *cache,
+    const char *args)
+{
+    if (args[0] == '[') {
+        return cmd_delete_w_filter(world, out, args);
+    }
+
+    ecs_entity_t e = parse_entity_id(world, cache, args);
+    if (!e) {
+        return -1;
+    }
+
+    ecs_delete(world, e);
+    buf_printf(out, "deleted entity '%s'\n", args);
+
+    return 0;
+}
+
+static
+console_staged_t* txn_entity(
+    console_txn_t *txn,
+    ecs_entity_t e)
+{
+    void **slot = map_ensure(&txn->index, (void*)(uintptr_t)e);
+    if (*slot) {
+        console_staged_t *staged = &txn->staged[(uintptr_t)*slot - 1];
+        if ((uintptr_t)*slot > (uintptr_t)txn->run_start || staged->delete) {
+            return staged;
+        }
+    }
+
+    if (txn->count == txn->size) {
+        txn->size = txn->size ? txn->size * 2 : 64;
+        txn->staged = ecs_os_realloc(
+            txn->staged, sizeof(console_staged_t) * txn->size);
+    }
+
+    *slot = (void*)(uintptr_t)(txn->count + 1);
+    txn->staged[txn->count] = (console_staged_t){ .entity = e };
+
+    return &txn->staged[txn->count ++];
+}
+
+static
+void txn_reset(
+    console_txn_t *txn)
+{
+    int32_t i;
+    for (i = 0; i < txn->count; i ++) {
+        ecs_os_free(txn->staged[i].add);
+        ecs_os_free(txn->staged[i].remove);
+    }
+
+    ecs_os_free(txn->staged);
+    ecs_os_free(txn->bulk);
+    map_free(&txn->index);
+
+    *txn = (console_txn_t){0};
+}
+
+/* Stage an add or remove of the components in type for an entity. The last
+ * operation on a component wins. Operations that do not change the entity
+ * are left out, but only before the first filter operation: after that the
+ * world no longer shows what the entity will have when this is applied. */
+static
+void txn_add_remove(
+    ecs_world_t *world,
+    console_txn_t *txn,
+    console_staged_t *staged,
+    ecs_type_t type,
+    bool is_remove)
+{
+    ecs_entity_t *components = ecs_vector_first(type);
+    int32_t i, count = ecs_vector_count(type);
+
+    for (i = 0; i < count; i ++) {
+        ecs_entity_t c = components[i];
+        bool owned = _ecs_has_owned(
+            world, staged->entity, ecs_type_from_entity(world, c));
+        bool known = !txn->bulk_count;
+        int32_t added = ids_find(staged->add, staged->add_count, c);
+        int32_t removed = ids_find(staged->remove, staged->remove_count, c);
+
+        if (is_remove) {
+            if (added != -1) {
+                ids_remove(staged->add, &staged->add_count, added);
+                txn->cancelled ++;
+            }
+            if (removed == -1 && (owned || !known)) {
+                ids_append(&staged->remove, &staged->remove_count, c);
+            }
+        } else {
+            if (removed != -1) {
+                ids_remove(staged->remove, &staged->remove_count, removed);
+                txn->cancelled ++;
+            }
+            if (added == -1 && (!owned || !known)) {
+                ids_append(&staged->add, &staged->add_count, c);
+            }
+        }
+    }
+}
+
+/* Stage an add, remove or delete command */
+static
+int txn_stage(
+    ecs_world_t *world,
+    ui_thread_t *ctx,
+    const char *args,
+    console_cmd_kind_t kind)
+{
+    console_txn_t *txn = &ctx->txn;
+
+    if (args[0] == '[') {
+        console_staged_bulk_t bulk = { .kind = kind };
+        const char *ptr = parse_filter_arg(world, args, &bulk.filter);
+        if (!ptr || !bulk.filter.include) {
+            return -1;
+        }
+
+        if (kind != ConsoleCmdDelete) {
+            if (!(bulk.type = parse_type_arg(world, &ctx->cache, ptr))) {
+                return -1;
+            }
+        } else if (ptr[0]) {
+            return -1;
+        }
+
+        bulk.position = txn->count;
+        txn->run_start = txn->count;
+
+        if (txn->bulk_count == txn->bulk_size) {
+            txn->bulk_size = txn->bulk_size ? txn->bulk_size * 2 : 16;
+            txn->bulk = ecs_os_realloc(txn->bulk, 
+                sizeof(console_staged_bulk_t) * txn->bulk_size);
+        }
+
+        txn->bulk[txn->bulk_count ++] = bulk;
+        txn->commands ++;
+
+        return 0;
+    }
+
+    char arg[256];
+    const char *ptr = args;
+    if (kind != ConsoleCmdDelete) {
+        if (!(ptr = parse_arg(args, arg))) {
+            return -1;
+        }
+
+        ptr ++;
+    } else {
+        strncpy(arg, args, sizeof(arg) - 1);
+        arg[sizeof(arg) - 1] = '\0';
+    }
+
+    ecs_entity_t e = parse_entity_id(world, &ctx->cache, arg);
+    if (!e) {
+        return -1;
+    }
+
+    ecs_type_t type = NULL;
+    if (kind != ConsoleCmdDelete) {
+        if (!(type = parse_type_arg(world, &ctx->cache, ptr))) {
+            return -1;
+        }
+    }
+
+    console_staged_t *staged = txn_entity(txn, e);
+    if (staged->delete) {
+        buf_printf(&ctx->out, "entity '%s' is staged for deletion\n", arg);
+        return -1;
+    }
+
+    if (kind == ConsoleCmdDelete) {
+        txn->cancelled += staged->add_count + staged->remove_count;
+        staged->add_count = 0;
+        staged->remove_count = 0;
+        staged->delete = true;
+    } else {
+        txn_add_remove(world, txn, staged, type, kind == ConsoleCmdRemove);
+    }
+
+    txn->commands ++;
+
+    return 0;
+}
+
+static
+int cmd_begin(
+    ui_thread_t *ctx)
+{
+    if (ctx->txn.active) {
+        buf_printf(&ctx->out, "transaction already started\n");
+        return -1;
+    }
+
+    ctx->txn.active = true;
+
+    return 0;
+}
+
+static
+int cmd_abort(
+    ui_thread_t *ctx)
+{
+    if (!ctx->txn.active) {
+        buf_printf(&ctx->out, "no transaction started\n");
+        return -1;
+    }
+
+    buf_printf(&ctx->out, "discarded %d commands\n", ctx->txn.commands);
+    txn_reset(&ctx->txn);
+
+    return 0;
+}
+
+/* Apply staged entity operations in [from, to) */
+static
+void txn_apply_entities(
+    ecs_world_t *world,
+    console_txn_t *txn,
+    int32_t from,
+    int32_t to,
+    int32_t *changed,
+    int32_t *deleted)
+{
+    int32_t i;
+    for (i = from; i < to; i ++) {
+        console_staged_t *staged = &txn->staged[i];
+        if (staged->delete) {
+            ecs_delete(world, staged->entity);
+            (*deleted) ++;
+        } else if (staged->add_count || staged->remove_count) {
+            _ecs_add_remove(world, staged->entity, 
+                ids_to_type(world, staged->add, staged->add_count),
+                ids_to_type(world, staged->remove, staged->remove_count));
+            (*changed) ++;
+        }
+    }
+}
+
+/* Apply staged mutations in the order they were staged. Within a run of
+ * entity operations each entity moves tables at most once, because its adds
+ * and removes are applied in a single ecs_add_remove. */
+static
+int cmd_commit(
+    ecs_world_t *world,
+    ui_thread_t *ctx)
+{
+    console_txn_t *txn = &ctx->txn;
+    int32_t i, applied = 0, changed = 0, deleted = 0;
+
+    if (!txn->active) {
+        buf_printf(&ctx->out, "no transaction started\n");
+        return -1;
+    }
+
+    for (i = 0; i < txn->bulk_count; i ++) {
+        console_staged_bulk_t *bulk = &txn->bulk[i];
+
+        txn_apply_entities(
+            world, txn, applied, bulk->position, &changed, &deleted);
+        applied = bulk->position;
+
+        if (bulk->kind == ConsoleCmdDelete) {
+            ecs_delete_w_filter(world, &bulk->filter);
+        } else if (bulk->kind == ConsoleCmdRemove) {
+            _ecs_add_remove_w_filter(world, NULL, bulk->type, &bulk->filter);
+        } else {
+            _ecs_add_remove_w_filter(world, bulk->type, NULL, &bulk->filter);
+        }
+    }
+
+    txn_apply_entities(world, txn, applied, txn->count, &changed, &deleted);
+
+    buf_printf(&ctx->out, 
+        "committed %d commands: %d entities changed, %d deleted, "
+        "%d filter operations, %d operations cancelled out\n", 
+        txn->commands, changed, deleted, txn->bulk_count, txn->cancelled);
+
+    txn_reset(txn);
+
+    return 0;
+}
+
+static
+void cmd_help(
+    console_buf_t *out)
+{
+    buf_printf(out, "Commands:\n");
+    buf_printf(out, " - [e]ntity entity                  - Display information about one or more matching entities\n");
+    buf_printf(out, " - [t]able  entity                  - Display information about one or more matching tables\n");
+    buf_printf(out, " - [s]ystem system                  - Display information about a matching system\n");
+    buf_printf(out, " - [m]atch  entity system           - Display if entity matches with system and why (not)\n");
+    buf_printf(out, " - [m]atch  [filter]|* system       - Group tables that do not match with system by reason\n");
+    buf_printf(out, " - [a]dd entity component           - Add component to entity\n");
+    buf_printf(out, " - [r]emove entity component        - Remove entity from component\n");
+    buf_printf(out, " - add|remove [filter] component    - Add or remove component for matching entities\n");
+    buf_printf(out, " - [d]elete entity                  - Delete entity\n");
+    buf_printf(out, " - [d]elete [filter]                - Delete all entities that match filter\n");
+    buf_printf(out, " - begin|commit|abort               - Stage add, remove and delete, apply at once\n");
+    buf_printf(out, " - snapshot                         - Take a snapshot of the current state\n");
+    buf_printf(out, " - snapshot save name [filter]      - Take a named snapshot, shares unchanged data\n");
+    buf_printf(out, " - snapshot list|drop name          - List named snapshots or drop a snapshot\n");
+    buf_printf(out, " - snapshot write file [name]       - Write a snapshot to a file (--compress lz|none)\n");
+    buf_printf(out, " - snapshot load file [name]        - Load a snapshot from a file as a named snapshot\n");
+    buf_printf(out, " - restore [name] [filter]          - Restore the previous or a named snapshot\n");
+    buf_printf(out, " - diff [name]                      - Show what changed since the previous or a named snapshot\n");
+    buf_printf(out, " - budget [us]                      - Show or set time per frame for listings\n");
+    buf_printf(out, " - next [--limit N]                 - Continue a listing that stopped at its limit\n");
+    buf_printf(out, " - complete text                    - Show commands or names that complete text\n");
+    buf_printf(out, " - profile [frames]                 - Measure time spent per system (default: 100 frames)\n");
+    buf_printf(out, " - frame [worst [N]|reset]          - Show frame time percentiles or slowest frames\n");
+    buf_printf(out, " - frame phases on|off              - Record time spent per pipeline phase\n");
+    buf_printf(out, " - churn [on|off|reset]             - Show entities moving between tables (--limit N)\n");
+    buf_printf(out, " - memory [components]              - Show memory per table or component (--by, --limit)\n");
+    buf_printf(out, " - layout system                    - Show how columns of a system use cache lines\n");
+    buf_printf(out, " - matrix [file]                    - Show which systems match most tables and vice versa\n");
+    buf_printf(out, " - count [filter] [--by-component]  - Count entities matching filter, or per component\n");
+    buf_printf(out, " - top tables [--by key]            - Largest tables by entities, memory or systems\n");
+    buf_printf(out, " - top systems [--by key]           - Largest systems by entities, tables or time\n");
+    buf_printf(out, "\n");
+    buf_printf(out, " entity, table, system and match accept the following options:\n");
+    buf_printf(out, " - --format text|json|csv           - Output format (default: text)\n");
+    buf_printf(out, " - --limit N                        - Show at most N rows, continue with 'next'\n");
+    buf_printf(out, " - --offset N                       - Skip the first N rows\n");
+    buf_printf(out, "\n");
+    buf_printf(out, " entity can be any of the following:\n");
+    buf_printf(out, " - id         (e.g. 42)\n");
+    buf_printf(out, " - name       (e.g. MyEntity)\n");
+    buf_printf(out, " - expression (e.g. [Position, Velocity], matches multiple)\n");
+    buf_printf(out, "\n");
+    buf_printf(out, " component, system can be any of the following:\n");
+    buf_printf(out, " - id         (e.g. 42)\n");
+    buf_printf(out, " - name       (e.g. MyEntity)\n");
+    buf_printf(out, "\n");
+    buf_printf(out, " If no argument is provided for either 'entity' or 'table', all entities or tables\n");
+    buf_printf(out, " are shown, respectively.\n");
+    buf_printf(out, "\n");
+    buf_printf(out, " Commands can be abbreviated to any unique prefix. Ending a line with a tab\n");
+    buf_printf(out, " shows how it can be completed.\n");
+    buf_printf(out, "\n");
+    buf_printf(out, "Examples:\n");
+    buf_printf(out, "  entity 42\n");
+    buf_printf(out, "  e 42\n");
+    buf_printf(out, "  e MyEntity\n");
+    buf_printf(out, "  e [Position, Velocity]\n");
+    buf_printf(out, "  add 42 Position\n");
+    buf_printf(out, "  match 42 Move\n");
+    buf_printf(out, "\n");
+}
+
+static
+int cmd_next(
+    ui_thread_t *ctx)
+{
+    if (!ctx->next.step) {
+        return -1;
+    }
+
+    ctx->job = ctx->next;
+    ctx->next = (console_job_t){0};
+
+    if (ctx->limit) {
+        ctx->job.limit = ctx->limit;
+    }
+
+    list_begin(&ctx->out, &ctx->job.list, ctx->job.list.fields, 
+        ctx->job.list.format);
+
+    return 0;
+}
+
+static
+int cmd_budget(
+    console_buf_t *out,
+    const char *args,
+    ui_thread_t *ctx)
+{
+    if (args[0]) {
+        int budget = atoi(args);
+        if (budget <= 0) {
+            return -1;
+        }
+
+        ctx->budget = budget;
+    }
+
+    buf_printf(out, "budget per frame: %uus\n", ctx->budget);
+
+    return 0;
+}
+
+/* Copy component values of all entities in a table. The debug API does not
+ * expose table columns, so values are fetched per entity. */
+static
+void image_gather(
+    ecs_world_t *world,
+    ecs_entity_t *entities,
+    int32_t count,
+    ecs_type_t type,
+    size_t size,
+    char *dst)
+{
+    int32_t i;
+    for (i = 0; i < count; i ++) {
+        void *ptr = _ecs_get_ptr(world, entities[i], type);
+        if (ptr) {
+            memcpy(&dst[i * size], ptr, size);
+        } else {
+            memset(&dst[i * size], 0, size);
+        }
+    }
+}
+
+static
+console_block_t* block_new(
+    size_t size)
+{
+    if (size > SIZE_MAX - sizeof(console_block_t)) {
+        return NULL;
+    }
+
+    console_block_t *block = ecs_os_malloc(sizeof(console_block_t) + size);
+    if (!block) {
+        return NULL;
+    }
+
+    block->refs = 1;
+    block->key = NULL;
+    block->size = size;
+    return block;
+}
+
+static
+void block_release(
+    console_block_t *block)
+{
+    if (block && !--block->refs) {
+        ecs_os_free(block);
+    }
+}
+
+/* Hash of the contents of a block, used as key in the map of live blocks.
+ * Blocks are not modified after they are filled, so the hash is cached. */
+static
+const void* block_key(
+    console_block_t *block)
+{
+    if (block->key) {
+        return block->key;
+    }
+
+    uint64_t h = 14695981039346656037ULL ^ block->size;
+    size_t i;
+
+    for (i = 0; i + sizeof(uint64_t) <= block->size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, &block->data[i], sizeof(uint64_t));
+        h = (h ^ word) * 1099511628211ULL;
+    }
+
+    for (; i < block->size; i ++) {
+        h = (h ^ (unsigned char)block->data[i]) * 1099511628211ULL;
+    }
+
+    block->key = (const void*)(uintptr_t)(h | 1);
+
+    return block->key;
+}
+
+/* Add the blocks of an image to a map from block_key to block */
+static
+void block_index(
+    console_map_t *blocks,
+    console_image_t *image)
+{
+    int32_t t, c;
+
+    for (t = 0; image && t < image->count; t ++) {
+        console_image_table_t *table = &image->tables[t];
+        *map_ensure(blocks, block_key(table->block)) = table->block;
+
+        for (c = 0; c < table->column_count; c ++) {
+            if (table->columns[c].block) {
+                *map_ensure(blocks, block_key(table->columns[c].block)) = 
+                    table->columns[c].block;
+            }
+        }
+    }
+}
+
+/* Return a live block with the same contents as block if there is one, so
+ * that the memory is shared with the snapshot that owns it */
+static
+console_block_t* block_share(
+    console_block_t *block,
+    console_map_t *blocks)
+{
+    console_block_t *live = map_get(blocks, block_key(block));
+    if (live && live->size == block->size && 
+        !memcmp(live->data, block->data, block->size)) 
+    {
+        block_release(block);
+        live->refs ++;
+        return live;
+    }
+
+    return block;
+}
+
+static
+void image_table_init(
+    ecs_world_t *world,
+    console_image_table_t *dst,
+    ecs_dbg_table_t *dbg,
+    console_map_t *blocks)
+{
+    int32_t i, count = dbg->entities_count;
+    ecs_entity_t *components = ecs_vector_first(dbg->type);
+
+    dst->type = dbg->type;
+    dst->count = count;
+    dst->block = block_new(sizeof(ecs_entity_t) * count);
+    memcpy(dst->block->data, dbg->entities, sizeof(ecs_entity_t) * count);
+    dst->block = block_share(dst->block, blocks);
+    dst->entities = (ecs_entity_t*)dst->block->data;
+
+    dst->column_count = ecs_vector_count(dbg->type);
+    dst->columns = ecs_os_calloc(
+        dst->column_count, sizeof(console_image_column_t));
+
+    for (i = 0; i < dst->column_count; i ++) {
+        console_image_column_t *column = &dst->columns[i];
+        column->component = components[i];
+        column->size = component_size(world, components[i]);
+
+        if (column->size) {
+            column->block = block_new(column->size * count);
+            image_gather(world, dst->entities, count, 
+                ecs_type_from_entity(world, components[i]), column->size, 
+                column->block->data);
+
+            column->block = block_share(column->block, blocks);
+            column->data = column->block->data;
+        }
+    }
+}
+
+static
+void image_free(
+    console_image_t *image)
+{
+    if (!image) {
+        return;
+    }
+
+    int32_t t, c;
+    for (t = 0; t < image->count; t ++) {
+        console_image_table_t *table = &image->tables[t];
+        for (c = 0; c < table->column_count; c ++) {
+            block_release(table->columns[c].block);
+        }
+
+        ecs_os_free(table->columns);
+        block_release(table->block);
+    }
+
+    ecs_os_free(image->tables);
+    ecs_os_free(image);
+}
+
+/* Tables of components and systems hold internal state of the world, such as
+ * the tables a system matched. Their values cannot be copied back safely, so
+ * snapshots, diffs and restores only look at tables that pass this filter. */
+static
+ecs_type_filter_t image_user_filter(
+    ecs_world_t *world)
+{
+    ecs_type_t builtin = ecs_type_merge(
+        world, ecs_type(EcsComponent), ecs_type(EcsTypeComponent), NULL);
+    builtin = ecs_type_merge(world, builtin, ecs_type(EcsColSystem), NULL);
+    builtin = ecs_type_merge(world, builtin, ecs_type(EcsRowSystem), NULL);
+
+    return (ecs_type_filter_t){ .exclude = builtin };
+}
+
+/* Copy tables that match the filter. Data is still copied in full, and then
+ * shared with blocks of live snapshots (see block_index) that are equal. */
+static
+console_image_t* image_take(
+    ecs_world_t *world,
+    ecs_type_filter_t *filter,
+    console_map_t *blocks)
+{
+    console_image_t *image = ecs_os_calloc(1, sizeof(console_image_t));
+    ecs_type_filter_t user = image_user_filter(world);
+    ecs_table_t *table;
+    int32_t i = 0, size = 0;
+
+    if (filter) {
+        image->filter = *filter;
+        image->has_filter = true;
+    }
+
+    while ((table = ecs_dbg_get_table(world, i ++))) {
+        if (!ecs_dbg_filter_table(world, table, &user)) {
+            continue;
+        }
+
+        if (filter && !ecs_dbg_filter_table(world, table, filter)) {
+            continue;
+        }
+
+        ecs_dbg_table_t dbg;
+        ecs_dbg_table(world, table, &dbg);
+        if (!dbg.entities_count) {
+            continue;
+        }
+
+        if (image->count == size) {
+            size = size ? size * 2 : 32;
+            image->tables = ecs_os_realloc(
+                image->tables, sizeof(console_image_table_t) * size);
+        }
+
+        image_table_init(
+            world, &image->tables[image->count ++], &dbg, blocks);
+    }
+
+    return image;
+}
+
+/* Test a type against a filter, for snapshot tables that may not exist in
+ * the world. Include matches all components, exclude matches any. */
+static
+bool filter_type(
+    ecs_world_t *world,
+    ecs_type_filter_t *filter,
+    ecs_type_t type)
+{
+    ecs_entity_t *include = ecs_vector_first(filter->include);
+    ecs_entity_t *exclude = ecs_vector_first(filter->exclude);
+    int32_t i, include_count = ecs_vector_count(filter->include);
+    int32_t exclude_count = ecs_vector_count(filter->exclude);
+
+    for (i = 0; i < include_count; i ++) {
+        if (!ecs_type_has_entity(world, type, include[i])) {
+            return false;
+        }
+    }
+
+    for (i = 0; i < exclude_count; i ++) {
+        if (ecs_type_has_entity(world, type, exclude[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Restore entities of a snapshot table one by one */
+static
+void image_restore_table(
+    ecs_world_t *world,
+    console_image_table_t *src)
+{
+    ecs_entity_t *components = ecs_vector_first(src->type);
+    int32_t i, c;
+
+    for (i = 0; i < src->count; i ++) {
+        ecs_entity_t e = src->entities[i];
+        ecs_dbg_entity_t dbg;
+        ecs_dbg_entity(world, e, &dbg);
+
+        if (dbg.type != src->type) {
+            ecs_entity_t *current = ecs_vector_first(dbg.type);
+            int32_t current_count = ecs_vector_count(dbg.type);
+
+            for (c = 0; c < current_count; c ++) {
+                if (!ecs_type_has_entity(world, src->type, current[c])) {
+                    _ecs_remove(world, e, 
+                        ecs_type_from_entity(world, current[c]));
+                }
+            }
+
+            _ecs_add(world, e, src->type);
+        }
+
+        for (c = 0; c < src->column_count; c ++) {
+            console_image_column_t *column = &src->columns[c];
+            if (column->size) {
+                _ecs_set_ptr(world, e, components[c], column->size, 
+                    &column->data[i * column->size]);
+            }
+        }
+    }
+}
+
+/* Restore a snapshot table that has the same entities as the world table.
+ * Only values that are different are set. Return true if nothing changed. */
+static
+bool image_restore_values(
+    ecs_world_t *world,
+    console_image_table_t *src,
+    char **scratch,
+    size_t *scratch_size)
+{
+    bool unchanged = true;
+    int32_t c, i;
+
+    for (c = 0; c < src->column_count; c ++) {
+        console_image_column_t *column = &src->columns[c];
+        size_t size = column->size, total = size * src->count;
+        if (!size) {
+            continue;
+        }
+
+        if (total > *scratch_size) {
+            *scratch = ecs_os_realloc(*scratch, total);
+            *scratch_size = total;
+        }
+
+        image_gather(world, src->entities, src->count, 
+            ecs_type_from_entity(world, column->component), size, *scratch);
+
+        if (!memcmp(*scratch, column->data, total)) {
+            continue;
+        }
+
+        for (i = 0; i < src->count; i ++) {
+            if (memcmp(&(*scratch)[i * size], &column->data[i * size], size)) {
+                _ecs_set_ptr(world, src->entities[i], column->component, size, 
+                    &column->data[i * size]);
+            }
+        }
+
+        unchanged = false;
+    }
+
+    return unchanged;
+}
+
+/* Restore the world to the state of the image, for tables that match the
+ * filter. Entities in scope that are not in the snapshot are deleted. Tables
+ * with the same entities as in the snapshot only have changed values set,
+ * and are skipped when nothing changed. Values are set through the regular
+ * API, so systems are notified of the change. Component and system tables
+ * are never restored or deleted. */
+static
+void image_restore(
+    ecs_world_t *world,
+    console_image_t *image,
+    ecs_type_filter_t *filter,
+    int32_t *restored_out,
+    int32_t *skipped_out)
+{
+    console_map_t entities = {0}, tables = {0};
+    ecs_type_filter_t user = image_user_filter(world);
+    ecs_entity_t *deleted = NULL;
+    ecs_table_t *table;
+    char *scratch = NULL;
+    size_t scratch_size = 0;
+    int32_t t, i, deleted_count = 0, deleted_size = 0;
+
+    /* All entities in the snapshot, so that entities that are out of scope
+     * in the snapshot are not deleted when they moved into scope */
+    for (t = 0; t < image->count; t ++) {
+        console_image_table_t *src = &image->tables[t];
+        for (i = 0; i < src->count; i ++) {
+            *map_ensure(&entities, (void*)(uintptr_t)src->entities[i]) = src;
+        }
+    }
+
+    /* Collect first, deleting entities while iterating moves them around */
+    t = 0;
+    while ((table = ecs_dbg_get_table(world, t ++))) {
+        ecs_dbg_table_t dbg;
+        ecs_dbg_table(world, table, &dbg);
+        *map_ensure(&tables, dbg.type) = table;
+
+        if (!ecs_dbg_filter_table(world, table, &user)) {
+            continue;
+        }
+
+        if (image->has_filter && 
+            !ecs_dbg_filter_table(world, table, &image->filter)) 
+        {
+            continue;
+        }
+
+        if (filter && !ecs_dbg_filter_table(world, table, filter)) {
+            continue;
+        }
+
+        for (i = 0; i < dbg.entities_count; i ++) {
+            ecs_entity_t e = dbg.entities[i];
+            if (map_get(&entities, (void*)(uintptr_t)e)) {
+                continue;
+            }
+
+            if (deleted_count == deleted_size) {
+                deleted_size = deleted_size ? deleted_size * 2 : 64;
+                deleted = ecs_os_realloc(
+                    deleted, sizeof(ecs_entity_t) * deleted_size);
+            }
+
+            deleted[deleted_count ++] = e;
+        }
+    }
+
+    for (i = 0; i < deleted_count; i ++) {
+        ecs_delete(world, deleted[i]);
+    }
+
+    for (t = 0; t < image->count; t ++) {
+        console_image_table_t *src = &image->tables[t];
+        if (!filter_type(world, &user, src->type)) {
+            continue;
+        }
+
+        if (filter && !filter_type(world, filter, src->type)) {
+            continue;
+        }
+
+        /* Tables that gained, lost or reordered entities are restored in
+         * full, otherwise only values that changed are set */
+        ecs_table_t *live = map_get(&tables, src->type);
+        if (live) {
+            ecs_dbg_table_t dbg;
+            ecs_dbg_table(world, live, &dbg);
+
+            if (dbg.entities_count == src->count && !memcmp(dbg.entities, 
+                src->entities, sizeof(ecs_entity_t) * src->count)) 
+            {
+                if (image_restore_values(
+                    world, src, &scratch, &scratch_size)) 
+                {
+                    (*skipped_out) ++;
+                } else {
+                    (*restored_out) ++;
+                }
+
+                continue;
+            }
+        }
+
+        image_restore_table(world, src);
+        (*restored_out) ++;
+    }
+
+    map_free(&tables);
+    map_free(&entities);
+    ecs_os_free(scratch);
+    ecs_os_free(deleted);
+}
+
+static
+int32_t named_find(
+    ui_thread_t *ctx,
+    const char *name)
+{
+    int32_t i;
+    for (i = 0; i < ctx->named_count; i ++) {
+        if (!strcmp(ctx->named[i].name, name)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static
+void named_drop(
+    ui_thread_t *ctx,
+    int32_t index)
+{
+    ecs_os_free(ctx->named[index].name);
+    image_free(ctx->named[index].image);
+
+    ctx->named_count --;
+    memmove(&ctx->named[index], &ctx->named[index + 1], 
+        sizeof(console_named_t) * (ctx->named_count - index));
+}
+
+/* Add a named snapshot, replaces a snapshot with the same name */
+static
+void named_add(
+    ui_thread_t *ctx,
+    const char *name,
+    console_image_t *image)
+{
+    int32_t index = named_find(ctx, name);
+    if (index != -1) {
+        named_drop(ctx, index);
+    }
+
+    ctx->named = ecs_os_realloc(ctx->named, 
+        sizeof(console_named_t) * (ctx->named_count + 1));
+    ctx->named[ctx->named_count ++] = (console_named_t){
+        .name = ecs_os_strdup(name),
+        .image = image
+    };
+}
+
+static
+const console_field_t snapshot_fields[] = {
+    {"name", "name", 16, false, "(unnamed)"},
+    {"tables", "tables", 8},
+    {"entities", "entities", 10},
+    {"size (KB)", "size_kb", 12},
+    {"unique (KB)", "unique_kb", 0},
+    {NULL}
+};
+
+/* List snapshots. Unique is the memory that is not shared with another
+ * snapshot, and is freed when the snapshot is dropped. */
+static
+void print_image_summary(
+    console_buf_t *out,
+    console_list_t *list,
+    const char *name,
+    console_image_t *image)
+{
+    size_t size = 0, unique = 0;
+    int32_t t, c, entities = 0;
+
+    for (t = 0; t < image->count; t ++) {
+        console_image_table_t *table = &image->tables[t];
+        entities += table->count;
+        size += table->block->size;
+        unique += table->block->refs == 1 ? table->block->size : 0;
+
+        for (c = 0; c < table->column_count; c ++) {
+            console_block_t *block = table->columns[c].block;
+            if (block) {
+                size += block->size;
+                unique += block->refs == 1 ? block->size : 0;
+            }
+        }
+    }
+
+    list_str(out, list, name);
+    list_int(out, list, image->count);
+    list_int(out, list, entities);
+    list_double(out, list, size / 1024.0);
+    list_double(out, list, unique / 1024.0);
+}
+
+static
+uint8_t* lz_write_varint(
+    uint8_t *dst,
+    uint64_t value)
+{
+    while (value >= 0x80) {
+        *(dst ++) = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+
+    *(dst ++) = (uint8_t)value;
+
+    return dst;
+}
+
+static
+const uint8_t* lz_read_varint(
+    const uint8_t *src,
+    const uint8_t *end,
+    uint64_t *value)
+{
+    int32_t shift = 0;
+    *value = 0;
+
+    while (src < end && shift < 64) {
+        uint8_t byte = *(src ++);
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return src;
+        }
+        shift += 7;
+    }
+
+    return NULL;
+}
+
+/* Size of the buffer that lz_compress needs for size bytes of input */
+static
+size_t lz_bound(
+    size_t size)
+{
+    return size * 2 + 32;
+}
+
+/* Compress a block as a sequence of (literal count, literals, match length,
+ * match offset). A match length of 0 ends the block. Matches are found with a
+ * single hash probe, which is fast and works well for columns that contain
+ * runs of zeros or repeated values. */
+static
+size_t lz_compress(
+    const uint8_t *src,
+    size_t size,
+    uint8_t *dst)
+{
+    uint32_t *table = ecs_os_calloc(1 << CONSOLE_LZ_HASH_BITS, sizeof(uint32_t));
+    uint8_t *out = dst;
+    size_t i = 0, anchor = 0;
+
+    while (i + CONSOLE_LZ_MIN_MATCH <= size && i < UINT32_MAX) {
+        uint32_t v;
+        memcpy(&v, &src[i], sizeof(uint32_t));
+
+        uint32_t h = (v * 2654435761u) >> (32 - CONSOLE_LZ_HASH_BITS);
+        size_t candidate = table[h];
+        table[h] = (uint32_t)i + 1;
+
+        if (!candidate || memcmp(&src[candidate - 1], &src[i], 
+            CONSOLE_LZ_MIN_MATCH)) 
+        {
+            i ++;
+            continue;
+        }
+
+        size_t match = candidate - 1, len = CONSOLE_LZ_MIN_MATCH;
+        while (i + len < size && src[match + len] == src[i + len]) {
+            len ++;
+        }
+
+        out = lz_write_varint(out, i - anchor);
+        memcpy(out, &src[anchor], i - anchor);
+        out += i - anchor;
+        out = lz_write_varint(out, len);
+        out = lz_write_varint(out, i - match);
+
+        i += len;
+        anchor = i;
+    }
+
+    out = lz_write_varint(out, size - anchor);
+    memcpy(out, &src[anchor], size - anchor);
+    out += size - anchor;
+    out = lz_write_varint(out, 0);
+
+    ecs_os_free(table);
+
+    return out - dst;
+}
+
+static
+int lz_decompress(
+    const uint8_t *src,
+    size_t stored,
+    uint8_t *dst,
+    size_t size)
+{
+    const uint8_t *end = src + stored;
+    size_t written = 0;
+
+    while (true) {
+        uint64_t literals, len, offset;
+        if (!(src = lz_read_varint(src, end, &literals))) {
+            return -1;
+        }
+
+        if (literals > (uint64_t)(end - src) || literals > size - written) {
+            return -1;
+        }
+
+        memcpy(&dst[written], src, literals);
+        src += literals;
+        written += literals;
+
+        if (!(src = lz_read_varint(src, end, &len))) {
+            return -1;
+        }
+
+        if (!len) {
+            break;
+        }
+
+        if (!(src = lz_read_varint(src, end, &offset))) {
+            return -1;
+        }
+
+        if (!offset || offset > written || len > size - written) {
+            return -1;
+        }
+
+        /* Byte by byte, matches may overlap with the data they produce */
+        size_t i;
+        for (i = 0; i < len; i ++) {
+            dst[written + i] = dst[written - offset + i];
+        }
+
+        written += len;
+    }
+
+    return written == size ? 0 : -1;
+}
+
+/* Write data and pad to a multiple of 8 bytes */
+static
+void file_write(
+    FILE *file,
+    const void *data,
+    size_t size)
+{
+    static const char zero[8] = {0};
+
+    fwrite(data, 1, size, file);
+    if (size % 8) {
+        fwrite(zero, 1, 8 - size % 8, file);
+    }
+}
+
+static
+void file_write_str(
+    FILE *file,
+    const char *str)
+{
+    uint32_t len = str ? strlen(str) : 0;
+    char *buf = ecs_os_malloc(sizeof(uint32_t) + len);
+    memcpy(buf, &len, sizeof(uint32_t));
+    if (len) {
+        memcpy(buf + sizeof(uint32_t), str, len);
+    }
+
+    file_write(file, buf, sizeof(uint32_t) + len);
+    ecs_os_free(buf);
+}
+
+/* Write a block, compressed when that makes it smaller. Return stored size. */
+static
+size_t file_write_block(
+    FILE *file,
+    const void *data,
+    size_t size,
+    bool compress)
+{
+    console_file_block_t hdr = {.size = size, .stored = size};
+    uint8_t *packed = NULL;
+
+    if (compress && size) {
+        packed = ecs_os_malloc(lz_bound(size));
+        hdr.stored = lz_compress(data, size, packed);
+        if (hdr.stored >= size) {
+            hdr.stored = size;
+        } else {
+            data = packed;
+        }
+    }
+
+    file_write(file, &hdr, sizeof(hdr));
+    file_write(file, data, hdr.stored);
+
+    ecs_os_free(packed);
+
+    return hdr.stored;
+}
+
+static
+int image_write(
+    ecs_world_t *world,
+    console_image_t *image,
+    const char *filename,
+    bool compress,
+    size_t *size_out,
+    size_t *stored_out)
+{
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        return -1;
+    }
+
+    console_file_header_t hdr = {
+        .magic = CONSOLE_FILE_MAGIC,
+        .version = CONSOLE_FILE_VERSION,
+        .flags = (compress ? CONSOLE_FILE_LZ : 0) | 
+            (image->has_filter ? CONSOLE_FILE_FILTER : 0),
+        .table_count = image->count
+    };
+
+    file_write(file, &hdr, sizeof(hdr));
+
+    /* The exclude half is stored as well, a restore of the snapshot would
+     * otherwise delete entities that were out of its scope */
+    char *expr = NULL;
+    if (image->has_filter && image->filter.include) {
+        expr = ecs_type_to_expr(world, image->filter.include);
+    }
+
+    file_write_str(file, expr);
+    ecs_os_free(expr);
+
+    expr = NULL;
+    if (image->has_filter && image->filter.exclude) {
+        expr = ecs_type_to_expr(world, image->filter.exclude);
+    }
+
+    file_write_str(file, expr);
+    ecs_os_free(expr);
+
+    int32_t t, c;
+    for (t = 0; t < image->count; t ++) {
+        console_image_table_t *table = &image->tables[t];
+        console_file_table_t table_hdr = {.count = table->count};
+
+        for (c = 0; c < table->column_count; c ++) {
+            table_hdr.column_count += table->columns[c].size != 0;
+        }
+
+        file_write(file, &table_hdr, sizeof(table_hdr));
+
+        expr = ecs_type_to_expr(world, table->type);
+        file_write_str(file, expr);
+        ecs_os_free(expr);
+
+        *size_out += table->block->size;
+        *stored_out += file_write_block(
+            file, table->entities, table->block->size, compress);
+
+        for (c = 0; c < table->column_count; c ++) {
+            console_image_column_t *column = &table->columns[c];
+            if (!column->size) {
+                continue;
+            }
+
+            console_file_column_t column_hdr = {
+                .component = column->component,
+                .size = column->size
+            };
+
+            file_write(file, &column_hdr, sizeof(column_hdr));
+            file_write_str(file, ecs_get_id(world, column->component));
+
+            *size_out += column->block->size;
+            *stored_out += file_write_block(
+                file, column->data, column->block->size, compress);
+        }
+    }
+
+    int result = ferror(file) ? -1 : 0;
+    fclose(file);
+
+    return result;
+}
+
+/* Read position in a loaded file */
+typedef struct console_reader_t {
+    const char *ptr;
+    const char *end;
+} console_reader_t;
+
+/* Return pointer to size bytes and move to the next 8 byte boundary, or NULL
+ * if the file is too short */
+static
+const void* file_read(
+    console_reader_t *reader,
+    size_t size)
+{
+    size_t padded = (size + 7) & ~(size_t)7;
+    if (padded < size || (size_t)(reader->end - reader->ptr) < padded) {
+        return NULL;
+    }
+
+    const void *result = reader->ptr;
+    reader->ptr += padded;
+
+    return result;
+}
+
+/* Return a copy of a string, or NULL if the file is too short */
+static
+char* file_read_str(
+    console_reader_t *reader)
+{
+    uint32_t count;
+    if ((size_t)(reader->end - reader->ptr) < sizeof(uint32_t)) {
+        return NULL;
+    }
+
+    memcpy(&count, reader->ptr, sizeof(uint32_t));
+
+    const char *str = file_read(reader, (size_t)count + sizeof(uint32_t));
+    if (!str) {
+        return NULL;
+    }
+
+    char *result = ecs_os_malloc(count + 1);
+    memcpy(result, str + sizeof(uint32_t), count);
+    result[count] = '\0';
+
+    return result;
+}
+
+/* Read a block of the expected size. The size is checked before memory is
+ * allocated, so a corrupt file cannot make the reader allocate any size. */
+static
+console_block_t* file_read_block(
+    console_reader_t *reader,
+    size_t expected)
+{
+    const console_file_block_t *hdr = file_read(
+        reader, sizeof(console_file_block_t));
+    if (!hdr || hdr->size != expected || hdr->stored > hdr->size) {
+        return NULL;
+    }
+
+    const void *data = file_read(reader, hdr->stored);
+    if (!data) {
+        return NULL;
+    }
+
+    console_block_t *block = block_new(hdr->size);
+    if (!block) {
+        return NULL;
+    }
+
+    if (hdr->stored == hdr->size) {
+        memcpy(block->data, data, hdr->size);
+    } else if (lz_decompress(data, hdr->stored, 
+        (uint8_t*)block->data, hdr->size)) 
+    {
+        block_release(block);
+        return NULL;
+    }
+
+    return block;
+}
+
+/* Components are stored by name, ids may be different in another process */
+static
+int image_read_table(
+    ecs_world_t *world,
+    console_reader_t *reader,
+    console_image_table_t *dst)
+{
+    const console_file_table_t *hdr = file_read(
+        reader, sizeof(console_file_table_t));
+    if (!hdr || hdr->count < 0 || hdr->column_count < 0 ||
+        (size_t)hdr->count > SIZE_MAX / sizeof(ecs_entity_t)) 
+    {
+        return -1;
+    }
+
+    char *expr = file_read_str(reader);
+    if (!expr) {
+        return -1;
+    }
+
+    dst->type = ecs_expr_to_type(world, expr);
+    ecs_os_free(expr);
+
+    /* Component and system tables of another world must not be restored */
+    ecs_type_filter_t user = image_user_filter(world);
+    if (dst->type && !filter_type(world, &user, dst->type)) {
+        return -1;
+    }
+
+    dst->count = hdr->count;
+    dst->block = file_read_block(reader, sizeof(ecs_entity_t) * hdr->count);
+    if (!dst->type || !dst->block) {
+        return -1;
+    }
+
+    dst->entities = (ecs_entity_t*)dst->block->data;
+
+    ecs_entity_t *components = ecs_vector_first(dst->type);
+    dst->column_count = ecs_vector_count(dst->type);
+    dst->columns = ecs_os_calloc(
+        dst->column_count, sizeof(console_image_column_t));
+
+    int32_t c, i;
+    for (c = 0; c < dst->column_count; c ++) {
+        dst->columns[c].component = components[c];
+    }
+
+    for (i = 0; i < hdr->column_count; i ++) {
+        const console_file_column_t *column_hdr = file_read(
+            reader, sizeof(console_file_column_t));
+        if (!column_hdr) {
+            return -1;
+        }
+
+        char *name = file_read_str(reader);
+        if (!name) {
+            return -1;
+        }
+
+        ecs_entity_t component = name[0] 
+            ? ecs_lookup(world, name) 
+            : column_hdr->component;
+        ecs_os_free(name);
+
+        for (c = 0; c < dst->column_count; c ++) {
+            if (dst->columns[c].component == component) {
+                break;
+            }
+        }
+
+        if (c == dst->column_count || dst->columns[c].block ||
+            !column_hdr->size ||
+            component_size(world, component) != column_hdr->size ||
+            (size_t)hdr->count > SIZE_MAX / column_hdr->size) 
+        {
+            return -1;
+        }
+
+        console_block_t *block = file_read_block(
+            reader, column_hdr->size * hdr->count);
+        if (!block) {
+            return -1;
+        }
+
+        dst->columns[c].size = column_hdr->size;
+        dst->columns[c].block = block;
+        dst->columns[c].data = block->data;
+    }
+
+    return 0;
+}
+
+static
+console_image_t* image_read(
+    ecs_world_t *world,
+    const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *buffer = size > 0 ? ecs_os_malloc(size) : NULL;
+    if (!buffer || fread(buffer, 1, size, file) != (size_t)size) {
+        ecs_os_free(buffer);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+
+    console_reader_t reader = {buffer, buffer + size};
+    const console_file_header_t *hdr = file_read(
+        &reader, sizeof(console_file_header_t));
+    /* Each table takes at least a table header, a type expression and an
+     * entity block, which bounds the number of tables by the file size */
+    size_t table_min = sizeof(console_file_table_t) + sizeof(uint64_t) + 
+        sizeof(console_file_block_t);
+    if (!hdr || hdr->magic != CONSOLE_FILE_MAGIC || 
+        hdr->version != CONSOLE_FILE_VERSION || hdr->table_count < 0 ||
+        (size_t)hdr->table_count > (size_t)(reader.end - reader.ptr) / table_min) 
+    {
+        ecs_os_free(buffer);
+        return NULL;
+    }
+
+    console_image_t *image = ecs_os_calloc(1, sizeof(console_image_t));
+    image->tables = ecs_os_calloc(
+        (size_t)hdr->table_count + 1, sizeof(console_image_table_t));
+    if (!image->tables) {
+        ecs_os_free(image);
+        ecs_os_free(buffer);
+        return NULL;
+    }
+
+    /* A filter that cannot be parsed in this world would widen the scope of
+     * the snapshot, so the file is rejected */
+    char *include = file_read_str(&reader);
+    char *exclude = include ? file_read_str(&reader) : NULL;
+    bool valid = exclude != NULL;
+
+    if (valid && (hdr->flags & CONSOLE_FILE_FILTER)) {
+        image->has_filter = true;
+        if (include[0]) {
+            image->filter.include = ecs_expr_to_type(world, include);
+            valid &= image->filter.include != NULL;
+        }
+
+        if (exclude[0]) {
+            image->filter.exclude = ecs_expr_to_type(world, exclude);
+            valid &= image->filter.exclude != NULL;
+        }
+    }
+
+    int32_t t;
+    for (t = 0; valid && t < hdr->table_count; t ++) {
+        image->count ++;
+        if (image_read_table(world, &reader, &image->tables[t])) {
+            break;
+        }
+    }
+
+    if (!valid || t != hdr->table_count) {
+        image_free(image);
+        image = NULL;
+    }
+
+    ecs_os_free(include);
+    ecs_os_free(exclude);
+    ecs_os_free(buffer);
+
+    return image;
+}
+
+int cmd_snapshot(
+    ecs_world_t *world, 
+    const char *args, 
+    ui_thread_t *ctx)
+{
+    char arg[64], name[64] = "";
+    const char *ptr = parse_word(args, arg, sizeof(arg));
+
+    if (!strcmp(arg, "list")) {
+        console_list_t list;
+        list_begin(&ctx->out, &list, snapshot_fields, ctx->format);
+
+        if (ctx->image) {
+            print_image_summary(&ctx->out, &list, NULL, ctx->image);
+        }
+
+        int32_t i;
+        for (i = 0; i < ctx->named_count; i ++) {
+            print_image_summary(
+                &ctx->out, &list, ctx->named[i].name, ctx->named[i].image);
+        }
+
+        list_end(&ctx->out, &list);
+        return 0;
+    }
+
+    if (!strcmp(arg, "drop")) {
+        parse_word(ptr, name, sizeof(name));
+        int32_t index = named_find(ctx, name);
+        if (index == -1) {
+            return -1;
+        }
+
+        named_drop(ctx, index);
+        return 0;
+    }
+
+    if (!strcmp(arg, "write")) {
+        char file[256];
+        ptr = parse_word(ptr, file, sizeof(file));
+        parse_word(ptr, name, sizeof(name));
+
+        console_image_t *image = ctx->image;
+        if (name[0]) {
+            int32_t index = named_find(ctx, name);
+            image = index != -1 ? ctx->named[index].image : NULL;
+        }
+
+        size_t size = 0, stored = 0;
+        if (!file[0] || !image || 
+            image_write(world, image, file, ctx->compress, &size, &stored)) 
+        {
+            return -1;
+        }
+
+        buf_printf(&ctx->out, "wrote %.2f KB to '%s' (%.2f KB uncompressed)\n",
+            stored / 1024.0, file, size / 1024.0);
+
+        return 0;
+    }
+
+    if (!strcmp(arg, "load")) {
+        char file[256];
+        ptr = parse_word(ptr, file, sizeof(file));
+        parse_word(ptr, name, sizeof(name));
+
+        console_image_t *image = image_read(world, file);
+        if (!image) {
+            buf_printf(&ctx->out, "cannot load snapshot from '%s'\n", file);
+            return -1;
+        }
+
+        named_add(ctx, name[0] ? name : file, image);
+
+        return 0;
+    }
+
+    if (!strcmp(arg, "save")) {
+        ptr = parse_word(ptr, name, sizeof(name));
+        if (!name[0]) {
+            return -1;
+        }
+
+        while (isspace(*ptr)) {
+            ptr ++;
+        }
+
+        args = ptr;
+    } else if (arg[0] && arg[0] != '[') {
+        return -1;
+    }
+
+    ecs_type_filter_t filter = {0};
+    if (args[0] == '[') {
+        if (parse_type_filter(world, args, &filter)) {
+            return -1;
+        }
+    }
+
+    /* Snapshots are restored from the console copy. Blocks that are equal to
+     * a block of any live snapshot are shared, so a snapshot only takes memory
+     * for data that is not in another snapshot. */
+    console_map_t blocks = {0};
+    int32_t i;
+
+    block_index(&blocks, ctx->image);
+    for (i = 0; i < ctx->named_count; i ++) {
+        block_index(&blocks, ctx->named[i].image);
+    }
+
+    console_image_t *image = image_take(
+        world, args[0] == '[' ? &filter : NULL, &blocks);
+
+    map_free(&blocks);
+
+    if (name[0]) {
+        named_add(ctx, name, image);
+        return 0;
+    }
+
+    image_free(ctx->image);
+    ctx->image = image;
+
+    return 0;
+}
+
+int cmd_restore(
+    ecs_world_t *world,
+    const char *args,
+    ui_thread_t *ctx)
+{
+    console_image_t *image = ctx->image;
+    char name[64] = "";
+
+    if (args[0] != '[') {
+        args = parse_word(args, name, sizeof(name));
+        while (isspace(*args)) {
+            args ++;
+        }
+    }
+
+    if (name[0]) {
+        int32_t index = named_find(ctx, name);
+        if (index == -1) {
+            return -1;
+        }
+
+        image = ctx->named[index].image;
+    }
+
+    ecs_type_filter_t filter = {0};
+    if (args[0] == '[' && parse_type_filter(world, args, &filter)) {
+        return -1;
+    }
+
+    if (!image) {
+        return -1;
+    }
+
+    int32_t restored = 0, skipped = 0;
+    image_restore(world, image, args[0] == '[' ? &filter : NULL, 
+        &restored, &skipped);
+
+    buf_printf(&ctx->out, "restored %d tables, skipped %d unchanged\n", 
+        restored, skipped);
+
+    /* A full restore of the unnamed snapshot consumes it */
+    if (!name[0] && args[0] != '[') {
+        image_free(ctx->image);
+        ctx->image = NULL;
+    }
+
+    return 0;
+}
+
+static
+const console_field_t diff_fields[] = {
+    {"change", "change", 10},
+    {"id", "id", 6},
+    {"name", "name", 20},
+    {"type", "type", 30, true},
+    {"detail", "detail", 0},
+    {NULL}
+};
+
+/* Location of an entity in the snapshot */
+typedef struct console_diff_entry_t {
+    int32_t table;            /* -1 once the entity is found in the world */
+    int32_t row;
+} console_diff_entry_t;
+
+static
+void print_diff_entity(
+    ecs_world_t *world,
+    console_buf_t *out,
+    console_list_t *list,
+    console_cache_t *cache,
+    const char *change,
+    ecs_entity_t entity,
+    ecs_type_t type,
+    const char *detail)
+{
+    const char *name = ecs_get_id(world, entity);
+
+    list_str(out, list, change);
+    list_int(out, list, entity);
+    list_str(out, list, name ? name : "");
+    list_str(out, list, cache_type_expr(world, cache, type));
+    list_str(out, list, detail);
+}
+
+static
+void print_diff_column(
+    ecs_world_t *world,
+    console_buf_t *out,
+    console_list_t *list,
+    console_cache_t *cache,
+    ecs_type_t type,
+    ecs_entity_t component,
+    int32_t changed,
+    int32_t count)
+{
+    const char *name = ecs_get_id(world, component);
+    char detail[64];
+    snprintf(detail, sizeof(detail), "%d of %d rows", changed, count);
+
+    list_str(out, list, "changed");
+    list_int(out, list, component);
+    list_str(out, list, name ? name : "");
+    list_str(out, list, cache_type_expr(world, cache, type));
+    list_str(out, list, detail);
+}
+
+/* Compare columns of a table whose entities did not change. A column is
+ * gathered into a scratch buffer and compared with a single memcmp, rows are
+ * only compared one by one when the column is different. */
+static
+void diff_columns(
+    ecs_world_t *world,
+    console_buf_t *out,
+    console_list_t *list,
+    console_cache_t *cache,
+    console_image_table_t *table,
+    char **scratch,
+    size_t *scratch_size)
+{
+    int32_t c, r;
+    for (c = 0; c < table->column_count; c ++) {
+        console_image_column_t *column = &table->columns[c];
+        size_t size = column->size, total = size * table->count;
+        if (!size) {
+            continue;
+        }
+
+        if (total > *scratch_size) {
+            *scratch = ecs_os_realloc(*scratch, total);
+            *scratch_size = total;
+        }
+
+        image_gather(world, table->entities, table->count, 
+            ecs_type_from_entity(world, column->component), size, *scratch);
+
+        if (!memcmp(*scratch, column->data, total)) {
+            continue;
+        }
+
+        int32_t changed = 0;
+        for (r = 0; r < table->count; r ++) {
+            changed += memcmp(
+                &(*scratch)[r * size], &column->data[r * size], size) != 0;
+        }
+
+        print_diff_column(world, out, list, cache, table->type, 
+            column->component, changed, table->count);
+    }
+}
+
+/* Compare the entities of tables that changed. Entities that are in the same
+ * table in the snapshot and the world have their values compared by row. */
+static
+void diff_entities(
+    ecs_world_t *world,
+    console_buf_t *out,
+    console_list_t *list,
+    console_cache_t *cache,
+    console_image_t *image,
+    bool *dirty,
+    ecs_table_t **tables,
+    int32_t table_count)
+{
+    console_map_t entities = {0};
+    int32_t t, i, entry_count = 0;
+
+    for (t = 0; t < image->count; t ++) {
+        if (dirty[t]) {
+            entry_count += image->tables[t].count;
+        }
+    }
+
+    console_diff_entry_t *entries = ecs_os_malloc(
+        sizeof(console_diff_entry_t) * (entry_count + 1));
+    entry_count = 0;
+
+    for (t = 0; t < image->count; t ++) {
+        if (!dirty[t]) {
+            continue;
+        }
+
+        console_image_table_t *table = &image->tables[t];
+        for (i = 0; i < table->count; i ++) {
+            console_diff_entry_t *entry = &entries[entry_count ++];
+            entry->table = t;
+            entry->row = i;
+            *map_ensure(&entities, (void*)(uintptr_t)table->entities[i]) = entry;
+        }
+    }
+
+    for (t = 0; t < table_count; t ++) {
+        ecs_dbg_table_t dbg;
+        ecs_dbg_table(world, tables[t], &dbg);
+
+        int32_t *changed = NULL, *compared = NULL, column_count = 0;
+        console_image_table_t *prev = NULL;
+
+        for (i = 0; i < dbg.entities_count; i ++) {
+            ecs_entity_t e = dbg.entities[i];
+            console_diff_entry_t *entry = map_get(
+                &entities, (void*)(uintptr_t)e);
+
+            if (!entry) {
+                print_diff_entity(
+                    world, out, list, cache, "added", e, dbg.type, NULL);
+                continue;
+            }
+
+            console_image_table_t *src = &image->tables[entry->table];
+            int32_t row = entry->row;
+            entry->table = -1;
+
+            if (src->type != dbg.type) {
+                char *from = ecs_type_to_expr(world, src->type);
+                char *detail = ecs_os_malloc(strlen(from) + 8);
+                sprintf(detail, "from [%s]", from);
+                print_diff_entity(
+                    world, out, list, cache, "moved", e, dbg.type, detail);
+                ecs_os_free(detail);
+                ecs_os_free(from);
+                continue;
+            }
+
+            if (!changed) {
+                prev = src;
+                column_count = src->column_count;
+                changed = ecs_os_calloc(column_count * 2, sizeof(int32_t));
+                compared = &changed[column_count];
+            }
+
+            int32_t c;
+            for (c = 0; c < column_count; c ++) {
+                console_image_column_t *column = &src->columns[c];
+                if (!column->size) {
+                    continue;
+                }
+
+                void *ptr = _ecs_get_ptr(world, e, 
+                    ecs_type_from_entity(world, column->component));
+                compared[c] ++;
+                if (ptr && memcmp(ptr, &column->data[row * column->size], 
+                    column->size)) 
+                {
+                    changed[c] ++;
+                }
+            }
+        }
+
+        if (changed) {
+            int32_t c;
+            for (c = 0; c < column_count; c ++) {
+                if (changed[c]) {
+                    print_diff_column(world, out, list, cache, dbg.type, 
+                        prev->columns[c].component, changed[c], compared[c]);
+                }
+            }
+
+            ecs_os_free(changed);
+        }
+    }
+
+    /* Entities that were not found in the world were deleted */
+    for (i = 0; i < entry_count; i ++) {
+        console_diff_entry_t *entry = &entries[i];
+        if (entry->table != -1) {
+            console_image_table_t *table = &image->tables[entry->table];
+            print_diff_entity(world, out, list, cache, "removed", 
+                table->entities[entry->row], table->type, NULL);
+        }
+    }
+
+    map_free(&entities);
+    ecs_os_free(entries);
+}
+
+/* Compare the snapshot with the world. Tables with the same entities in the
+ * same order only have their columns compared, entity changes are only
+ * computed for tables in which entities were added, removed or moved. */
+static
+int cmd_diff(
+    ecs_world_t *world,
+    const char *args,
+    ui_thread_t *ctx)
+{
+    console_buf_t *out = &ctx->out;
+    console_cache_t *cache = &ctx->cache;
+    console_image_t *image = ctx->image;
+    char name[64];
+
+    parse_word(args, name, sizeof(name));
+    if (name[0]) {
+        int32_t index = named_find(ctx, name);
+        image = index != -1 ? ctx->named[index].image : NULL;
+    }
+
+    if (!image) {
+        return -1;
+    }
+
+    console_map_t types = {0};
+    ecs_type_filter_t user = image_user_filter(world);
+    bool *dirty = ecs_os_calloc(image->count + 1, sizeof(bool));
+    bool *found = ecs_os_calloc(image->count + 1, sizeof(bool));
+    ecs_table_t **tables = NULL, *table;
+    int32_t i = 0, t, table_count = 0, table_size = 0;
+    char *scratch = NULL;
+    size_t scratch_size = 0;
+
+    for (t = 0; t < image->count; t ++) {
+        *map_ensure(&types, image->tables[t].type) = &image->tables[t];
+    }
+
+    console_list_t list;
+    list_begin(out, &list, diff_fields, ctx->format);
+
+    while ((table = ecs_dbg_get_table(world, i ++))) {
+        if (!ecs_dbg_filter_table(world, table, &user)) {
+            continue;
+        }
+
+        if (image->has_filter && 
+            !ecs_dbg_filter_table(world, table, &image->filter)) 
+        {
+            continue;
+        }
+
+        ecs_dbg_table_t dbg;
+        ecs_dbg_table(world, table, &dbg);
+
+        console_image_table_t *src = map_get(&types, dbg.type);
+        if (src) {
+            found[src - image->tables] = true;
+            if (src->count == dbg.entities_count && !memcmp(src->entities, 
+                dbg.entities, sizeof(ecs_entity_t) * src->count)) 
+            {
+                diff_columns(world, out, &list, cache, src, &scratch, 
+                    &scratch_size);
+                continue;
+            }
+
+            dirty[src - image->tables] = true;
+        } else if (!dbg.entities_count) {
+            continue;
+        }
+
+        if (table_count == table_size) {
+            table_size = table_size ? table_size * 2 : 32;
+            tables = ecs_os_realloc(tables, sizeof(ecs_table_t*) * table_size);
+        }
+
+        tables[table_count ++] = table;
+    }
+
+    /* Tables that are no longer in the world, or no longer match the filter */
+    for (t = 0; t < image->count; t ++) {
+        if (!found[t]) {
+            dirty[t] = true;
+        }
+    }
+
+    diff_entities(
+        world, out, &list, cache, image, dirty, tables, table_count);
+
+    list_end(out, &list);
+
+    map_free(&types);
+    ecs_os_free(scratch);
+    ecs_os_free(tables);
+    ecs_os_free(found);
+    ecs_os_free(dirty);
+
+    return 0;
+}
+
+/* Memory of a table, or of all columns of a component */
+typedef struct console_memory_t {
+    int32_t id;               /* table id, or component */
+    ecs_type_t type;
+    int32_t tables;
+    int32_t entities;
+    size_t used;
+    size_t allocated;
+    uint64_t key;             /* sort key */
+} console_memory_t;
+
+/* The debug API does not expose column capacity. Columns grow by doubling,
+ * so capacity is estimated as the next power of two of the highest entity
+ * count seen by the console. Columns are not shrunk when entities are
+ * removed, so tables that were emptied still hold memory. */
+static
+int32_t capacity_estimate(
+    ui_thread_t *ctx,
+    int32_t table,
+    int32_t count)
+{
+    if (table >= ctx->peak_count) {
+        ctx->peaks = ecs_os_realloc(ctx->peaks, sizeof(int32_t) * (table + 1));
+        memset(&ctx->peaks[ctx->peak_count], 0, 
+            sizeof(int32_t) * (table + 1 - ctx->peak_count));
+        ctx->peak_count = table + 1;
+    }
+
+    if (count > ctx->peaks[table]) {
+        ctx->peaks[table] = count;
+    }
+
+    int32_t capacity = ctx->peaks[table] ? 1 : 0;
+    while (capacity && capacity < ctx->peaks[table]) {
+        capacity *= 2;
+    }
+
+    return capacity;
+}
+
+/* Bytes per entity in a table: the entity id and one value per component */
+static
+size_t table_row_size(
+    ecs_world_t *world,
+    ecs_type_t type)
+{
+    ecs_entity_t *components = ecs_vector_first(type);
+    int32_t c, count = ecs_vector_count(type);
+    size_t size = sizeof(ecs_entity_t);
+
+    for (c = 0; c < count; c ++) {
+        size += component_size(world, components[c]);
+    }
+
+    return size;
+}
+
+static
+int memory_compare(
+    const void *p1,
+    const void *p2)
+{
+    const console_memory_t *m1 = p1, *m2 = p2;
+    return (m1->key < m2->key) - (m1->key > m2->key);
+}
+
+static
+int memory_sort(
+    ui_thread_t *ctx,
+    console_memory_t *rows,
+    int32_t count)
+{
+    int32_t i;
+    for (i = 0; i < count; i ++) {
+        console_memory_t *row = &rows[i];
+        if (!ctx->by[0] || !strcmp(ctx->by, "allocated")) {
+            row->key = row->allocated;
+        } else if (!strcmp(ctx->by, "used")) {
+            row->key = row->used;
+        } else if (!strcmp(ctx->by, "unused")) {
+            row->key = row->allocated - row->used;
+        } else if (!strcmp(ctx->by, "entities")) {
+            row->key = row->entities;
+        } else {
+            return -1;
+        }
+    }
+
+    if (count) {
+        qsort(rows, count, sizeof(console_memory_t), memory_compare);
+    }
+
+    return 0;
+}
+
+static
+const console_field_t memory_table_fields[] = {
+    {"id", "id", 6},
+    {"type", "type", 40, true},
+    {"entities", "entities", 10},
+    {"used (KB)", "used_kb", 12},
+    {"allocated (KB)", "allocated_kb", 0},
+    {NULL}
+};
+
+static
+const console_field_t memory_component_fields[] = {
+    {"id", "id", 6},
+    {"component", "component", 24},
+    {"tables", "tables", 8},
+    {"entities", "entities", 10},
+    {"used (KB)", "used_kb", 12},
+    {"allocated (KB)", "allocated_kb", 0},
+    {NULL}
+};
+
+/* Report memory used by table columns. Each table has a column with entity
+ * ids, and one column per component with data. */
+static
+int cmd_memory(
+    ecs_world_t *world,
+    const char *args,
+    ui_thread_t *ctx)
+{
+    char arg[32];
+    parse_word(args, arg, sizeof(arg));
+
+    bool by_component = !strcmp(arg, "components");
+    if (arg[0] && !by_component) {
+        return -1;
+    }
+
+    console_memory_t *rows = NULL;
+    console_map_t components = {0};
+    ecs_table_t *table;
+    int32_t i = 0, c, count = 0, size = 0, empty = 0;
+    size_t used = 0, allocated = 0, empty_allocated = 0;
+
+    while ((table = ecs_dbg_get_table(world, i))) {
+        ecs_dbg_table_t dbg;
+        ecs_dbg_table(world, table, &dbg);
+
+        int32_t capacity = capacity_estimate(ctx, i, dbg.entities_count);
+        ecs_entity_t *type = ecs_vector_first(dbg.type);
+        int32_t type_count = ecs_vector_count(dbg.type);
+        size_t row_size = table_row_size(world, dbg.type);
+
+        for (c = 0; by_component && c < type_count; c ++) {
+            size_t column_size = component_size(world, type[c]);
+            if (column_size) {
+                void **slot = map_ensure(
+                    &components, (void*)(uintptr_t)type[c]);
+                if (!*slot) {
+                    console_memory_t *m = ecs_os_calloc(
+                        1, sizeof(console_memory_t));
+                    m->id = (int32_t)type[c];
+                    *slot = m;
+                }
+
+                console_memory_t *m = *slot;
+                m->tables ++;
+                m->entities += dbg.entities_count;
+                m->used += column_size * dbg.entities_count;
+                m->allocated += column_size * capacity;
+            }
+        }
+
+        used += row_size * dbg.entities_count;
+        allocated += row_size * capacity;
+
+        if (!dbg.entities_count && capacity) {
+            empty ++;
+            empty_allocated += row_size * capacity;
+        }
+
+        if (!by_component) {
+            if (count == size) {
+                size = size ? size * 2 : 64;
+                rows = ecs_os_realloc(rows, sizeof(console_memory_t) * size);
+            }
+
+            rows[count ++] = (console_memory_t){
+                .id = i + 1,
+                .type = dbg.type,
+                .tables = 1,
+                .entities = dbg.entities_count,
+                .used = row_size * dbg.entities_count,
+                .allocated = row_size * capacity
+            };
+        }
+
+        i ++;
+    }
+
+    if (by_component) {
+        rows = ecs_os_malloc(sizeof(console_memory_t) * (components.count + 1));
+        for (c = 0; c < (int32_t)components.size; c ++) {
+            if (components.keys[c]) {
+                rows[count ++] = *(console_memory_t*)components.values[c];
+            }
+        }
+
+        map_clear(&components);
+        map_free(&components);
+    }
+
+    if (memory_sort(ctx, rows, count)) {
+        ecs_os_free(rows);
+        return -1;
+    }
+
+    console_buf_t *out = &ctx->out;
+    if (ctx->format == ConsoleText) {
+        buf_printf(out, "%.2f KB used, %.2f KB allocated in %d tables\n", 
+            used / 1024.0, allocated / 1024.0, i);
+        buf_printf(out, "%d empty tables hold %.2f KB\n", 
+            empty, empty_allocated / 1024.0);
+    }
+
+    console_list_t list;
+    list_begin(out, &list, by_component 
+        ? memory_component_fields : memory_table_fields, ctx->format);
+
+    int32_t limit = ctx->limit ? ctx->limit : 20;
+    for (i = 0; i < count && i < limit; i ++) {
+        console_memory_t *row = &rows[i];
+        list_int(out, &list, row->id);
+        if (by_component) {
+            const char *name = ecs_get_id(world, row->id);
+            list_str(out, &list, name ? name : "");
+            list_int(out, &list, row->tables);
+        } else {
+            list_str(out, &list, cache_type_expr(world, &ctx->cache, row->type));
+        }
+
+        list_int(out, &list, row->entities);
+        list_double(out, &list, row->used / 1024.0);
+        list_double(out, &list, row->allocated / 1024.0);
+    }
+
+    list_end(out, &list);
+
+    ecs_os_free(rows);
+
+    return 0;
+}
+
+/* Add index to bitset. Indices must be added in increasing order. */
+static
+void bitset_add(
+    console_bitset_t *set,
+    int32_t index)
+{
+    uint16_t key = index >> 16, low = index & 0xFFFF;
+    console_bitset_container_t *c = NULL;
+
+    if (set->count) {
+        c = &set->containers[set->count - 1];
+    }
+
+    if (!c || c->key != key) {
+        set->containers = ecs_os_realloc(set->containers, 
+            sizeof(console_bitset_container_t) * (set->count + 1));
+        c = &set->containers[set->count ++];
+        *c = (console_bitset_container_t){.key = key};
+    }
+
+    if (c->bitmap) {
+        c->bitmap[low / 64] |= 1ull << (low % 64);
+    } else if (c->count < CONSOLE_BITSET_ARRAY_MAX) {
+        /* Grow by doubling, array only grows to its max size */
+        if (!(c->count & (c->count - 1))) {
+            c->array = ecs_os_realloc(
+                c->array, sizeof(uint16_t) * (c->count ? c->count * 2 : 4));
+        }
+
+        c->array[c->count] = low;
+    } else {
+        c->bitmap = ecs_os_calloc(CONSOLE_BITSET_WORDS, sizeof(uint64_t));
+
+        int32_t i;
+        for (i = 0; i < c->count; i ++) {
+            c->bitmap[c->array[i] / 64] |= 1ull << (c->array[i] % 64);
+        }
+
+        c->bitmap[low / 64] |= 1ull << (low % 64);
+        ecs_os_free(c->array);
+        c->array = NULL;
+    }
+
+    c->count ++;
+    set->cardinality ++;
+}
+
+static
+size_t bitset_size(
+    console_bitset_t *set)
+{
+    size_t size = 0;
+    int32_t i;
+    for (i = 0; i < set->count; i ++) {
+        console_bitset_container_t *c = &set->containers[i];
+        size += sizeof(console_matrix_container_t);
+        size += c->bitmap 
+            ? CONSOLE_BITSET_WORDS * sizeof(uint64_t)
+            : c->count * sizeof(uint16_t);
+    }
+
+    return size;
+}
+
+static
+void bitset_free(
+    console_bitset_t *set)
+{
+    int32_t i;
+    for (i = 0; i < set->count; i ++) {
+        ecs_os_free(set->containers[i].array);
+        ecs_os_free(set->containers[i].bitmap);
+    }
+
+    ecs_os_free(set->containers);
+}
+
+/* Row of the matrix report, either a system or a table */
+typedef struct console_fanout_t {
+    ecs_entity_t system;
+    ecs_type_t type;
+    int32_t id;
+    int32_t matched;          /* tables matched by system, or the reverse */
+    int32_t entities;
+    console_bitset_t tables;
+} console_fanout_t;
+
+static
+int fanout_compare(
+    const void *p1,
+    const void *p2)
+{
+    const console_fanout_t *f1 = p1, *f2 = p2;
+    return (f1->matched < f2->matched) - (f1->matched > f2->matched);
+}
+
+static
+int matrix_write(
+    ecs_world_t *world,
+    const char *filename,
+    ecs_type_t *types,
+    int32_t table_count,
+    console_fanout_t *systems,
+    int32_t system_count)
+{
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        return -1;
+    }
+
+    console_matrix_header_t hdr = {
+        .magic = CONSOLE_MATRIX_MAGIC,
+        .version = CONSOLE_MATRIX_VERSION,
+        .table_count = table_count,
+        .system_count = system_count
+    };
+
+    file_write(file, &hdr, sizeof(hdr));
+
+    int32_t i, c;
+    for (i = 0; i < table_count; i ++) {
+        char *expr = ecs_type_to_expr(world, types[i]);
+        file_write_str(file, expr);
+        ecs_os_free(expr);
+    }
+
+    for (i = 0; i < system_count; i ++) {
+        console_bitset_t *set = &systems[i].tables;
+        console_matrix_system_t system_hdr = {
+            .system = systems[i].system,
+            .container_count = set->count,
+            .count = set->cardinality
+        };
+
+        file_write(file, &system_hdr, sizeof(system_hdr));
+        file_write_str(file, ecs_get_id(world, systems[i].system));
+
+        for (c = 0; c < set->count; c ++) {
+            console_bitset_container_t *container = &set->containers[c];
+            console_matrix_container_t container_hdr = {
+                .key = container->key,
+                .is_bitmap = container->bitmap != NULL,
+                .count = container->count
+            };
+
+            file_write(file, &container_hdr, sizeof(container_hdr));
+            if (container->bitmap) {
+                file_write(file, container->bitmap, 
+                    CONSOLE_BITSET_WORDS * sizeof(uint64_t));
+            } else {
+                file_write(file, container->array, 
+                    container->count * sizeof(uint16_t));
+            }
+        }
+    }
+
+    int result = ferror(file) ? -1 : 0;
+    fclose(file);
+
+    return result;
+}
+
+static
+const console_field_t fanout_system_fields[] = {
+    {"id", "id", 6},
+    {"system", "system", 24},
+    {"tables", "tables", 8},
+    {"entities", "entities", 0},
+    {NULL}
+};
+
+static
+const console_field_t fanout_table_fields[] = {
+    {"id", "id", 6},
+    {"type", "type", 48, true},
+    {"systems", "systems", 8},
+    {"entities", "entities", 0},
+    {NULL}
+};
+
+/* Build the table x system match relation. Each matched table is iterated by
+ * each system it matches with, so tables and systems at the top of the fan out
+ * lists are where matching and iteration overhead accumulates. */
+static
+int cmd_matrix(
+    ecs_world_t *world,
+    const char *args,
+    ui_thread_t *ctx)
+{
+    char filename[256];
+    parse_word(args, filename, sizeof(filename));
+
+    console_fanout_t *tables = NULL, *systems = NULL;
+    console_map_t index = {0}; /* system -> index + 1 in systems */
+    ecs_type_t *types = NULL;
+    ecs_table_t *table;
+    int32_t i = 0, s, table_count = 0, system_count = 0, pairs = 0;
+    int32_t table_size = 0, system_size = 0;
+    int64_t iterated = 0;
+
+    while ((table = ecs_dbg_get_table(world, i))) {
+        ecs_dbg_table_t dbg;
+        ecs_dbg_table(world, table, &dbg);
+
+        if (i == table_size) {
+            table_size = table_size ? table_size * 2 : 64;
+            tables = ecs_os_realloc(
+                tables, sizeof(console_fanout_t) * table_size);
+            types = ecs_os_realloc(types, sizeof(ecs_type_t) * table_size);
+        }
+
+        types[i] = dbg.type;
+
+        int32_t count = ecs_vector_count(dbg.systems_matched);
+        ecs_entity_t *matched = ecs_vector_first(dbg.systems_matched);
+
+        tables[i] = (console_fanout_t){
+            .type = dbg.type,
+            .id = i + 1,
+            .matched = count,
+            .entities = dbg.entities_count
+        };
+
+        for (s = 0; s < count; s ++) {
+            void **slot = map_ensure(&index, (void*)(uintptr_t)matched[s]);
+            if (!*slot) {
+                if (system_count == system_size) {
+                    system_size = system_size ? system_size * 2 : 64;
+                    systems = ecs_os_realloc(
+                        systems, sizeof(console_fanout_t) * system_size);
+                }
+
+                systems[system_count] = (console_fanout_t){
+                    .system = matched[s],
+                    .id = (int32_t)matched[s]
+                };
+
+                *slot = (void*)(uintptr_t)++ system_count;
+            }
+
+            console_fanout_t *system = &systems[(uintptr_t)*slot - 1];
+            bitset_add(&system->tables, i);
+            system->matched ++;
+            system->entities += dbg.entities_count;
+        }
+
+        pairs += count;
+        iterated += (int64_t)count * dbg.entities_count;
+        i ++;
+    }
+
+    table_count = i;
+    map_free(&index);
+
+    size_t compressed = 0;
+    for (s = 0; s < system_count; s ++) {
+        compressed += bitset_size(&systems[s].tables);
+    }
+
+    int result = 0;
+    if (filename[0]) {
+        result = matrix_write(
+            world, filename, types, table_count, systems, system_count);
+        if (result) {
+            buf_printf(&ctx->out, "cannot write matrix to '%s'\n", filename);
+        }
+    }
+
+    console_buf_t *out = &ctx->out;
+    if (!result && ctx->format == ConsoleText) {
+        buf_printf(out, "%d tables, %d systems, %d matches\n", 
+            table_count, system_count, pairs);
+        buf_printf(out, "%lld entities iterated per frame by all systems\n",
+            (long long)iterated);
+        buf_printf(out, "matrix is %.2f KB compressed, %.2f KB dense\n",
+            compressed / 1024.0, 
+            ((size_t)table_count * system_count + 7) / 8 / 1024.0);
+        if (filename[0]) {
+            buf_printf(out, "wrote matrix to '%s'\n", filename);
+        }
+    }
+
+    if (!result) {
+        int32_t limit = ctx->limit ? ctx->limit : 10;
+        if (system_count) {
+            qsort(systems, system_count, sizeof(console_fanout_t), 
+                fanout_compare);
+        }
+        if (table_count) {
+            qsort(tables, table_count, sizeof(console_fanout_t), 
+                fanout_compare);
+        }
+
+        console_list_t list;
+        list_begin(out, &list, fanout_system_fields, ctx->format);
+        for (s = 0; s < system_count && s < limit; s ++) {
+            const char *name = ecs_get_id(world, systems[s].system);
+            list_int(out, &list, systems[s].id);
+            list_str(out, &list, name ? name : "");
+            list_int(out, &list, systems[s].matched);
+            list_int(out, &list, systems[s].entities);
+        }
+        list_end(out, &list);
+
+        list_begin(out, &list, fanout_table_fields, ctx->format);
+        for (i = 0; i < table_count && i < limit; i ++) {
+            list_int(out, &list, tables[i].id);
+            list_str(out, &list, 
+                cache_type_expr(world, &ctx->cache, tables[i].type));
+            list_int(out, &list, tables[i].matched);
+            list_int(out, &list, tables[i].entities);
+        }
+        list_end(out, &list);
+    }
+
+    for (s = 0; s < system_count; s ++) {
+        bitset_free(&systems[s].tables);
+    }
+
+    ecs_os_free(systems);
+    ecs_os_free(tables);
+    ecs_os_free(types);
+
+    return result;
+}
+
+/* Entities and tables with a component */
+typedef struct console_count_t {
+    ecs_entity_t component;
+    int32_t tables;
+    int32_t entities;
+} console_count_t;
+
+static
+int count_compare(
+    const void *p1,
+    const void *p2)
+{
+    const console_count_t *c1 = p1, *c2 = p2;
+    return (c1->entities < c2->entities) - (c1->entities > c2->entities);
+}
+
+static
+const console_field_t count_fields[] = {
+    {"id", "id", 6},
+    {"component", "component", 24},
+    {"tables", "tables", 8},
+    {"entities", "entities", 0},
+    {NULL}
+};
+
+/* Count entities from table sizes, without visiting entities */
+static
+int cmd_count(
+    ecs_world_t *world,
+    const char *args,
+    ui_thread_t *ctx)
+{
+    ecs_type_filter_t filter = {0};
+    bool has_filter = args[0] != '\0';
+
+    if (has_filter) {
+        const char *end = parse_filter_arg(world, args, &filter);
+        if (!end || end[0]) {
+            return -1;
+        }
+    }
+
+    console_count_t *counts = NULL;
+    console_map_t index = {0}; /* component -> index + 1 in counts */
+    ecs_table_t *table;
+    int32_t i = 0, c, count = 0, size = 0, tables = 0, entities = 0;
+
+    while ((table = ecs_dbg_get_table(world, i ++))) {
+        if (has_filter && !ecs_dbg_filter_table(world, table, &filter)) {
+            continue;
+        }
+
+        ecs_dbg_table_t dbg;
+        ecs_dbg_table(world, table, &dbg);
+        if (!dbg.entities_count) {
+            continue;
+        }
+
+        tables ++;
+        entities += dbg.entities_count;
+
+        if (!ctx->by_component) {
+            continue;
+        }
+
+        ecs_entity_t *type = ecs_vector_first(dbg.type);
+        int32_t type_count = ecs_vector_count(dbg.type);
+
+        for (c = 0; c < type_count; c ++) {
+            void **slot = map_ensure(&index, (void*)(uintptr_t)type[c]);
+            if (!*slot) {
+                if (count == size) {
+                    size = size ? size * 2 : 32;
+                    counts = ecs_os_realloc(
+                        counts, sizeof(console_count_t) * size);
+                }
+
+                counts[count] = (console_count_t){.component = type[c]};
+                *slot = (void*)(uintptr_t)++ count;
+            }
+
+            console_count_t *cnt = &counts[(uintptr_t)*slot - 1];
+            cnt->tables ++;
+            cnt->entities += dbg.entities_count;
+        }
+    }
+
+    map_free(&index);
+
+    console_buf_t *out = &ctx->out;
+
+    if (!ctx->by_component) {
+        console_record_t record;
+        record_begin(out, &record, ctx->format, 10);
+        record_int(out, &record, "entities", "entities", entities);
+        record_int(out, &record, "tables", "tables", tables);
+        record_end(out, &record);
+        return 0;
+    }
+
+    if (ctx->format == ConsoleText) {
+        buf_printf(out, "%d entities in %d tables\n", entities, tables);
+    }
+
+    if (count) {
+        qsort(counts, count, sizeof(console_count_t), count_compare);
+    }
+
+    console_list_t list;
+    list_begin(out, &list, count_fields, ctx->format);
+
+    for (c = ctx->offset; c < count; c ++) {
+        if (ctx->limit && c - ctx->offset >= ctx->limit) {
+            break;
+        }
+
+        const char *name = ecs_get_id(world, counts[c].component);
+        list_int(out, &list, counts[c].component);
+        list_str(out, &list, name ? name : "");
+        list_int(out, &list, counts[c].tables);
+        list_int(out, &list, counts[c].entities);
+    }
+
+    list_end(out, &list);
+
+    ecs_os_free(counts);
+
+    return 0;
+}
+
+/* Row ranked by 'top', either a table or a system */
+typedef struct console_top_t {
+    double key;
+    int32_t id;
+    ecs_type_t type;
+    ecs_entity_t system;
+    int32_t entities;
+    int32_t matched;          /* systems matched by table, or the reverse */
+    size_t memory;
+    double time;
+} console_top_t;
+
+/* Min-heap that keeps the N rows with the largest keys */
+typedef struct console_heap_t {
+    console_top_t *rows;
+    int32_t count;
+    int32_t size;
+} console_heap_t;
+
+static
+void heap_swap(
+    console_top_t *rows,
+    int32_t i,
+    int32_t j)
+{
+    console_top_t tmp = rows[i];
+    rows[i] = rows[j];
+    rows[j] = tmp;
+}
+
+static
+void heap_push(
+    console_heap_t *heap,
+    const console_top_t *row)
+{
+    console_top_t *rows = heap->rows;
+    int32_t i;
+
+    if (heap->count < heap->size) {
+        i = heap->count ++;
+        rows[i] = *row;
+
+        while (i && rows[(i - 1) / 2].key > rows[i].key) {
+            heap_swap(rows, i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+
+        return;
+    }
+
+    /* Row is not larger than the smallest row on the heap */
+    if (!heap->count || row->key <= rows[0].key) {
+        return;
+    }
+
+    rows[0] = *row;
+    i = 0;
+
+    while (true) {
+        int32_t smallest = i, l = i * 2 + 1, r = i * 2 + 2;
+        if (l < heap->count && rows[l].key < rows[smallest].key) {
+            smallest = l;
+        }
+        if (r < heap->count && rows[r].key < rows[smallest].key) {
+            smallest = r;
+        }
+        if (smallest == i) {
+            break;
+        }
+
+        heap_swap(rows, i, smallest);
+        i = smallest;
+    }
+}
+
+static
+int top_compare(
+    const void *p1,
+    const void *p2)
+{
+    double k1 = ((const console_top_t*)p1)->key;
+    double k2 = ((const console_top_t*)p2)->key;
+    return (k1 < k2) - (k1 > k2);
+}
+
+static
+const console_field_t top_table_fields[] = {
+    {"id", "id", 6},
+    {"type", "type", 48, true},
+    {"entities", "entities", 10},
+    {"memory (KB)", "memory_kb", 14},
+    {"systems", "systems", 0},
+    {NULL}
+};
+
+static
+const console_field_t top_system_fields[] = {
+    {"id", "id", 6},
+    {"system", "system", 24},
+    {"entities", "entities", 10},
+    {"tables", "tables", 8},
+    {"time (ms)", "time_ms", 0},
+    {NULL}
+};
+
+static
+int top_tables(
+    ecs_world_t *world,
+    ui_thread_t *ctx,
+    console_heap_t *heap)
+{
+    const char *by = ctx->by[0] ? ctx->by : "entities";
+    if (strcmp(by, "entities") && strcmp(by, "memory") && 
+        strcmp(by, "systems")) 
+    {
+        return -1;
+    }
+
+    ecs_table_t *table;
+    int32_t i = 0;
+
+    while ((table = ecs_dbg_get_table(world, i))) {
+        ecs_dbg_table_t dbg;
+        ecs_dbg_table(world, table, &dbg);
+
+        size_t row_size = table_row_size(world, dbg.type);
+
+        console_top_t row = {
+            .id = i + 1,
+            .type = dbg.type,
+            .entities = dbg.entities_count,
+            .matched = ecs_vector_count(dbg.systems_matched),
+            .memory = row_size * capacity_estimate(ctx, i, dbg.entities_count)
+        };
+
+        if (!strcmp(by, "entities")) {
+            row.key = row.entities;
+        } else if (!strcmp(by, "memory")) {
+            row.key = row.memory;
+        } else {
+            row.key = row.matched;
+        }
+
+        heap_push(heap, &row);
+        i ++;
+    }
+
+    return 0;
+}
+
+/* System time is the time measured while measuring was enabled, for example
+ * while profiling */
+static
+int top_systems(
+    ecs_world_t *world,
+    ui_thread_t *ctx,
+    console_heap_t *heap)
+{
+    const char *by = ctx->by[0] ? ctx->by : "entities";
+    if (strcmp(by, "entities") && strcmp(by, "tables") && strcmp(by, "time")) {
+        return -1;
+    }
+
+    EcsWorldStats stats = {0};
+    ecs_get_stats(world, &stats);
+
+    /* Time per system. Systems outside the pipeline phases are in the
+     * stats as well, and systems without stats are ranked with no time. */
+    ecs_vector_t *lists[CONSOLE_PHASE_COUNT + 3] = {
+        stats.task_systems, stats.inactive_systems, stats.on_demand_systems
+    };
+
+    console_map_t times = {0}; /* system -> EcsSystemStats* */
+    bool measured = false;
+    int32_t i, l;
+
+    for (l = 0; l < CONSOLE_PHASE_COUNT; l ++) {
+        lists[l + 3] = stats_phase(&stats, l);
+    }
+
+    for (l = 0; l < CONSOLE_PHASE_COUNT + 3; l ++) {
+        EcsSystemStats *buffer = ecs_vector_first(lists[l]);
+        int32_t count = ecs_vector_count(lists[l]);
+        for (i = 0; i < count; i ++) {
+            *map_ensure(&times, (void*)(uintptr_t)buffer[i].handle) = 
+                &buffer[i];
+            measured |= buffer[i].time_spent > 0;
+        }
+    }
+
+    /* Times measured by an earlier profile remain valid */
+    if (!strcmp(by, "time") && !measured) {
+        buf_printf(&ctx->out, 
+            "system time is not measured, use 'profile' to measure it\n");
+    }
+
+    ecs_type_filter_t filter = {
+        .include = ecs_type(EcsColSystem)
+    };
+
+    ecs_table_t *table;
+    int32_t t = 0;
+
+    while ((table = ecs_dbg_get_table(world, t ++))) {
+        if (!ecs_dbg_filter_table(world, table, &filter)) {
+            continue;
+        }
+
+        ecs_dbg_table_t table_dbg;
+        ecs_dbg_table(world, table, &table_dbg);
+
+        for (i = 0; i < table_dbg.entities_count; i ++) {
+            ecs_entity_t system = table_dbg.entities[i];
+            ecs_dbg_col_system_t dbg;
+            if (ecs_dbg_col_system(world, system, &dbg)) {
+                continue;
+            }
+
+            EcsSystemStats *system_stats = map_get(
+                &times, (void*)(uintptr_t)system);
+
+            console_top_t row = {
+                .id = (int32_t)system,
+                .system = system,
+                .entities = dbg.entities_matched_count,
+                .matched = dbg.active_table_count + dbg.inactive_table_count,
+                .time = system_stats ? system_stats->time_spent : 0
+            };
+
+            if (!strcmp(by, "entities")) {
+                row.key = row.entities;
+            } else if (!strcmp(by, "tables")) {
+                row.key = row.matched;
+            } else {
+                row.key = row.time;
+            }
+
+            heap_push(heap, &row);
+        }
+    }
+
+    map_free(&times);
+    ecs_free_stats(&stats);
+
     return 0;
 }
 
+/* Rank tables or systems. Only the largest rows are kept, so ranking costs
+ * O(n log limit) and does not sort all tables. */
 static
-int dump_system(
+int cmd_top(
     ecs_world_t *world,
-    ecs_entity_t system)
+    const char *args,
+    ui_thread_t *ctx)
 {
-    uint32_t column_width = 32;
-    ecs_dbg_col_system_t dbg;
-    if (ecs_dbg_col_system(world, system, &dbg)) {
+    char arg[32];
+    parse_word(args, arg, sizeof(arg));
+
+    bool tables = !strcmp(arg, "tables");
+    if (!tables && strcmp(arg, "systems")) {
         return -1;
     }
 
-    print_column("id:", column_width);
-    printf("%lld\n", system);
+    console_heap_t heap = {
+        .size = ctx->limit ? ctx->limit : 20
+    };
+
+    heap.rows = ecs_os_malloc(sizeof(console_top_t) * heap.size);
 
-    print_column("name:", column_width);
-    printf("%s\n", ecs_get_id(world, system));
+    int result = tables 
+        ? top_tables(world, ctx, &heap) 
+        : top_systems(world, ctx, &heap);
+
+    if (result) {
+        ecs_os_free(heap.rows);
+        return -1;
+    }
 
-    print_column("enabled:", column_width);
-    printf("%s\n", dbg.enabled ? "true" : "false");
+    if (heap.count) {
+        qsort(heap.rows, heap.count, sizeof(console_top_t), top_compare);
+    }
 
-    print_column("entities matched:", column_width);
-    printf("%d\n", dbg.entities_matched_count);
+    console_buf_t *out = &ctx->out;
+    console_list_t list;
+    list_begin(out, &list, 
+        tables ? top_table_fields : top_system_fields, ctx->format);
+
+    int32_t i;
+    for (i = 0; i < heap.count; i ++) {
+        console_top_t *row = &heap.rows[i];
+        list_int(out, &list, row->id);
+
+        if (tables) {
+            list_str(out, &list, cache_type_expr(world, &ctx->cache, row->type));
+            list_int(out, &list, row->entities);
+            list_double(out, &list, row->memory / 1024.0);
+            list_int(out, &list, row->matched);
+        } else {
+            const char *name = ecs_get_id(world, row->system);
+            list_str(out, &list, name ? name : "");
+            list_int(out, &list, row->entities);
+            list_int(out, &list, row->matched);
+            list_double(out, &list, row->time * 1000.0);
+        }
+    }
 
-    print_column("active matched:", column_width);
-    printf("%d\n", dbg.active_table_count);
+    list_end(out, &list);
 
-    print_column("inactive matched:", column_width);
-    printf("%d\n", dbg.inactive_table_count);
+    ecs_os_free(heap.rows);
 
     return 0;
 }
 
 static
-int dump_systems(
-    ecs_world_t *world) 
+const console_cmd_desc_t console_cmds[] = {
+    {"entity", ConsoleCmdEntity},
+    {"table", ConsoleCmdTable},
+    {"system", ConsoleCmdSystem},
+    {"match", ConsoleCmdMatch},
+    {"add", ConsoleCmdAdd},
+    {"remove", ConsoleCmdRemove},
+    {"delete", ConsoleCmdDelete},
+    {"help", ConsoleCmdHelp},
+    {"quit", ConsoleCmdQuit},
+    {"snapshot", ConsoleCmdSnapshot},
+    {"restore", ConsoleCmdRestore},
+    {"budget", ConsoleCmdBudget},
+    {"next", ConsoleCmdNext},
+    {"complete", ConsoleCmdComplete},
+    {"profile", ConsoleCmdProfile},
+    {"frame", ConsoleCmdFrame},
+    {"diff", ConsoleCmdDiff},
+    {"begin", ConsoleCmdBegin},
+    {"commit", ConsoleCmdCommit},
+    {"abort", ConsoleCmdAbort},
+    {"churn", ConsoleCmdChurn},
+    {"memory", ConsoleCmdMemory},
+    {"layout", ConsoleCmdLayout},
+    {"matrix", ConsoleCmdMatrix},
+    {"count", ConsoleCmdCount},
+    {"top", ConsoleCmdTop},
+
+    /* Single letter shortcuts take precedence over prefixes */
+    {"e", ConsoleCmdEntity, true},
+    {"t", ConsoleCmdTable, true},
+    {"s", ConsoleCmdSystem, true},
+    {"m", ConsoleCmdMatch, true},
+    {"a", ConsoleCmdAdd, true},
+    {"r", ConsoleCmdRemove, true},
+    {"d", ConsoleCmdDelete, true},
+    {NULL}
+};
+
+static
+int16_t trie_child(
+    ui_thread_t *ctx,
+    int16_t node,
+    char ch,
+    bool create)
 {
-    ecs_type_filter_t filter = {
-        .include = ecs_type(EcsColSystem)
+    int16_t *link = &ctx->trie[node].child;
+
+    while (*link) {
+        if (ctx->trie[*link].ch == ch) {
+            return *link;
+        }
+        link = &ctx->trie[*link].sibling;
+    }
+
+    /* The trie is built from console_cmds, which fits in CONSOLE_TRIE_SIZE */
+    if (!create || ctx->trie_count == CONSOLE_TRIE_SIZE) {
+        return -1;
+    }
+
+    int16_t result = ctx->trie_count ++;
+    ctx->trie[result] = (console_trie_t){
+        .ch = ch,
+        .cmd = -1,
+        .unique = -1
     };
 
-    printf("\n");
-    print_column("id", 4);
-    print_column("name", 20);
-    print_column("tables matched", 18);
-    print_column("entities matched", 0);
-    print_line(4 + 20 + 12 + strlen("entities matched"));
+    *link = result;
 
-    ecs_table_t *table;
-    int i = 0;
-    while ((table = ecs_dbg_get_table(world, i ++))) {
-        if (!ecs_dbg_filter_table(world, table, &filter)) {
-            continue;
-        }
+    return result;
+}
 
-        ecs_dbg_table_t dbg;
-        ecs_dbg_table(world, table, &dbg);
+static
+void trie_build(
+    ui_thread_t *ctx)
+{
+    int16_t i;
+
+    ctx->trie[0] = (console_trie_t){
+        .cmd = -1,
+        .unique = -2
+    };
+    ctx->trie_count = 1;
+
+    for (i = 0; console_cmds[i].name; i ++) {
+        const char *ptr;
+        int16_t node = 0;
 
-        int e;
-        for (e = 0; e < dbg.entities_count; e++) {
-            print_system_summary(world, dbg.entities[e]);
+        for (ptr = console_cmds[i].name; *ptr; ptr ++) {
+            node = trie_child(ctx, node, *ptr, true);
+            if (node < 0) {
+                return;
+            }
+
+            /* Aliases do not make a prefix ambiguous */
+            if (!console_cmds[i].alias) {
+                console_trie_t *n = &ctx->trie[node];
+                if (n->unique == -1) {
+                    n->unique = i;
+                } else if (n->unique != i) {
+                    n->unique = -2;
+                }
+            }
         }
-    }
 
-    return 0;
+        ctx->trie[node].cmd = i;
+    }
 }
 
+/* Walk the trie for the first word of cmd. Returns the trie node, or -1 if no
+ * command starts with the word. */
 static
-int cmd_system(
-    ecs_world_t *world,
-    const char *args)
+int16_t trie_walk(
+    ui_thread_t *ctx,
+    const char *cmd,
+    const char **args_out)
 {
-    if (!args[0]) {
-        return dump_systems(world);
-    } else {
-        ecs_entity_t e = parse_entity_id(world, args);
-        if (!e) {
+    const char *ptr = cmd;
+    int16_t node = 0;
+
+    while (*ptr && !isspace(*ptr)) {
+        node = trie_child(ctx, node, *ptr, false);
+        if (node < 0) {
             return -1;
         }
+        ptr ++;
+    }
 
-        dump_system(world, e);
+    while (isspace(*ptr)) {
+        ptr ++;
     }
 
-    return 0;
+    if (args_out) {
+        *args_out = ptr;
+    }
+
+    return node;
 }
 
 static
-int cmd_match(
-    ecs_world_t *world,
-    const char *args)
+void trie_print(
+    ui_thread_t *ctx,
+    console_buf_t *out,
+    int16_t node)
 {
-    char arg[256];
-    const char *ptr = parse_arg(args, arg);
-    if (!ptr) {
-        return -1;
+    if (ctx->trie[node].cmd >= 0 && !console_cmds[ctx->trie[node].cmd].alias) {
+        buf_printf(out, "%s\n", console_cmds[ctx->trie[node].cmd].name);
     }
 
-    /* Skip whitespace */
-    ptr ++;
-
-    ecs_entity_t e = parse_entity_id(world, arg);
-    if (!e) {
-        return -1;
-    }     
+    int16_t child;
+    for (child = ctx->trie[node].child; child; child = ctx->trie[child].sibling) {
+        trie_print(ctx, out, child);
+    }
+}
 
-    ecs_entity_t system = parse_entity_id(world, ptr);
-    if (!system) {
+/* Find command by name, shortcut or unique prefix */
+static
+int32_t trie_find(
+    ui_thread_t *ctx,
+    const char *cmd,
+    const char **args_out)
+{
+    int16_t node = trie_walk(ctx, cmd, args_out);
+    if (node <= 0) {
         return -1;
     }
 
-    ecs_dbg_match_failure_t failure_info = {0};
-    if (ecs_dbg_match_entity(world, e, system, &failure_info)) {
-        printf("entitiy '%s' matches with system '%s'\n", 
-            arg, ecs_get_id(world, system));
-    } else {
-        printf("entity '%s' does not match with system '%s'\n", 
-            arg, ecs_get_id(world, system));
-
-        ecs_type_t type = NULL;
-        char *type_expr = NULL;
-
-        if (failure_info.column) {
-            type = ecs_dbg_get_column_type(
-                world, system, failure_info.column);
-            type_expr = ecs_type_to_expr(world, type);
-            printf("column %d: ", failure_info.column);
-        }
-
-        switch(failure_info.reason) {
-        case EcsMatchOk:
-            break;
-        case EcsMatchNotASystem:
-            printf("entity '%s' is not a system\n", ptr);
-            break;
-        case EcsMatchSystemIsATask:
-            printf("system is a task\n");
-            break;
-        case EcsMatchEntityIsDisabled:
-            printf("entity is disabled\n");
-            break;
-        case EcsMatchEntityIsPrefab:
-            printf("entity is a prefab\n");
-            break;
-        case EcsMatchFromSelf:
-            printf("[%s] missing (owned or shared)\n", type_expr);
-            break;
-        case EcsMatchFromOwned:
-            printf("[%s] missing (owned)\n", type_expr);
-            break;
-        case EcsMatchFromShared:
-            printf("[%s] missing (shared)\n", type_expr);
-            break;
-        case EcsMatchFromContainer:
-            printf("[%s] missing (container)\n", type_expr);
-            break;
-        case EcsMatchFromEntity:
-            printf(
-                "[%s] missing (from entity, system will never run!)\n", 
-                type_expr);
-            break;
-        case EcsMatchOrFromSelf:
-            printf("[%s] missing in OR expression (owned or shared)\n", type_expr);
-            break;
-        case EcsMatchOrFromContainer:
-            printf("[%s] missing in OR expression (from container)\n", type_expr);
-            break;
-        case EcsMatchNotFromSelf:
-            printf("has [%s] from NOT expression (owned or shared)\n", type_expr);
-            break;
-        case EcsMatchNotFromOwned:
-            printf("has [%s] in NOT expression (owned)\n", type_expr);
-            break;
-        case EcsMatchNotFromShared:
-            printf("has [%s] in NOT expression (shared)\n", type_expr);
-            break;
-        case EcsMatchNotFromContainer:
-            printf("has [%s] in NOT expression (from container)\n", type_expr);
-            break;
-        }
+    console_trie_t *n = &ctx->trie[node];
+    if (n->cmd >= 0) {
+        return n->cmd;
+    }
 
-        ecs_os_free(type_expr);      
+    if (n->unique >= 0) {
+        return n->unique;
     }
 
-    return 0;
+    buf_str(&ctx->out, "ambiguous command, did you mean:\n");
+    trie_print(ctx, &ctx->out, node);
+
+    return -1;
 }
 
+/* Show commands or names that start with the last word of args */
 static
-int cmd_add_remove(
+int cmd_complete(
     ecs_world_t *world,
     const char *args,
-    bool is_remove)
+    ui_thread_t *ctx)
 {
-    char arg[256];
-    const char *ptr = parse_arg(args, arg);
-    if (!ptr) {
-        return -1;
-    }
-
-    /* Skip whitespace */
-    ptr ++;
+    console_buf_t *out = &ctx->out;
+    const char *word = args + strlen(args);
 
-    ecs_entity_t e = parse_entity_id(world, arg);
-    if (!e) {
-        return -1;
+    while (word != args && !isspace(word[-1]) && word[-1] != '[' && 
+        word[-1] != ',') 
+    {
+        word --;
     }
 
-    ecs_type_t type;
-
-    if (ptr[0] == '[') {
-        ecs_type_filter_t filter = {0};
-        if (parse_type_filter(world, ptr, &filter)) {
-            return -1;
-        }
-
-        type = filter.include;
-    } else {
-        ecs_entity_t component = parse_entity_id(world, ptr);
-        if (!component) {
-            return -1;
+    /* First word is a command */
+    if (word == args) {
+        int16_t node = trie_walk(ctx, args, NULL);
+        if (node >= 0) {
+            trie_print(ctx, out, node);
         }
-
-        type = ecs_type_from_entity(world, component);
+        return 0;
     }
 
-    char *type_expr = ecs_type_to_expr(world, type);
+    uint32_t i, count;
+    char **names = names_prefix(&ctx->cache.names, word, &count);
 
-    if (is_remove) {
-        if (!_ecs_has_owned(world, e, type)) {
-            if (_ecs_has(world, e, type)) {
-                printf("entity '%s' does not own [%s]\n", arg, type_expr);
-            } else {
-                printf("entity '%s' does not have [%s]\n", arg, type_expr);
-            }
-        } else {
-            _ecs_remove(world, e, type);
-            if (_ecs_has(world, e, type)) {
-                printf("removed override [%s] from entity '%s'\n", type_expr, arg);
-            } else {
-                printf("removed [%s] from entity '%s'\n", type_expr, arg);
-            }
-        }
+    if (count == 1) {
+        buf_strn(out, args, word - args);
+        buf_str(out, names[0]);
+        buf_char(out, '\n');
     } else {
-        if (_ecs_has_owned(world, e, type)) {
-            printf("entity '%s' already has [%s]\n", arg, type_expr);
-        } else {
-            if (_ecs_has(world, e, type)) {
-                _ecs_add(world, e, type);
-                printf("overridden [%s] for entity '%s'\n", type_expr, arg);
-            } else {
-                _ecs_add(world, e, type);
-                printf("added [%s] to entity '%s'\n", type_expr, arg);
-            }
+        for (i = 0; i < count && i < 20; i ++) {
+            buf_str(out, names[i]);
+            buf_char(out, '\n');
         }
-    }
 
-    ecs_os_free(type_expr);
+        if (count > i) {
+            buf_printf(out, "... %u more\n", count - i);
+        }
+    }
 
     return 0;
 }
 
 static
-int cmd_delete(
-    ecs_world_t *world,
-    const char *args)
+int exec_cmd(
+    ecs_world_t *world, 
+    const char *cmd,
+    ui_thread_t *ctx) 
 {
-    ecs_entity_t e = parse_entity_id(world, args);
-    if (!e) {
+    const char *args;
+
+    if (!cmd[0]) {
+        return 0;
+    }
+
+    int32_t index = trie_find(ctx, cmd, &args);
+    if (index < 0) {
         return -1;
     }
 
-    ecs_delete(world, e);
-    printf("deleted entity '%s'\n", args);
-
-    return 0;
-}
-
-static
-void cmd_help()
-{
-    printf("Commands:\n");
-    printf(" - [e]ntity entity                  - Display information about one or more matching entities\n");
-    printf(" - [t]able  entity                  - Display information about one or more matching tables\n");
-    printf(" - [s]ystem system                  - Display information about a matching system\n");
-    printf(" - [m]atch  entity system           - Display if entity matches with system and why (not)\n");
-    printf(" - [a]dd entity component           - Add component to entity\n");
-    printf(" - [r]emove entity component        - Remove entity from component\n");
-    printf(" - [d]elete entity                  - Delete entity\n");
-    printf(" - snapshot                         - Take a snapshot of the current state\n");
-    printf(" - restore                          - Restore the previous snapshot\n");
-    printf("\n");
-    printf(" entity can be any of the following:\n");
-    printf(" - id         (e.g. 42)\n");
-    printf(" - name       (e.g. MyEntity)\n");
-    printf(" - expression (e.g. [Position, Velocity], matches multiple)\n");
-    printf("\n");
-    printf(" component, system can be any of the following:\n");
-    printf(" - id         (e.g. 42)\n");
-    printf(" - name       (e.g. MyEntity)\n");
-    printf("\n");
-    printf(" If no argument is provided for either 'entity' or 'table', all entities or tables\n");
-    printf(" are shown, respectively.\n");
-    printf("\n");
-    printf("Examples:\n");
-    printf("  entity 42\n");
-    printf("  e 42\n");
-    printf("  e MyEntity\n");
-    printf("  e [Position, Velocity]\n");
-    printf("  add 42 Position\n");
-    printf("  match 42 Move\n");
-    printf("\n");
+    switch(console_cmds[index].kind) {
+    case ConsoleCmdTable:
+        return cmd_table(world, args, ctx);
+    case ConsoleCmdSystem:
+        return cmd_system(world, args, ctx);
+    case ConsoleCmdEntity:
+        return cmd_entity(world, args, ctx);
+    case ConsoleCmdMatch:
+        return cmd_match(world, &ctx->out, &ctx->cache, ctx->format, args);
+    case ConsoleCmdAdd:
+    case ConsoleCmdRemove:
+    case ConsoleCmdDelete:
+        if (ctx->txn.active) {
+            return txn_stage(world, ctx, args, console_cmds[index].kind);
+        }
+        if (console_cmds[index].kind == ConsoleCmdDelete) {
+            return cmd_delete(world, &ctx->out, &ctx->cache, args);
+        }
+        return cmd_add_remove(world, &ctx->out, &ctx->cache, args, 
+            console_cmds[index].kind == ConsoleCmdRemove);
+    case ConsoleCmdHelp:
+        cmd_help(&ctx->out);
+        return 0;
+    case ConsoleCmdQuit:
+        ecs_quit(world);
+        return 0;
+    case ConsoleCmdSnapshot:
+        return cmd_snapshot(world, args, ctx);
+    case ConsoleCmdRestore:
+        return cmd_restore(world, args, ctx);
+    case ConsoleCmdBudget:
+        return cmd_budget(&ctx->out, args, ctx);
+    case ConsoleCmdNext:
+        return cmd_next(ctx);
+    case ConsoleCmdComplete:
+        return cmd_complete(world, args, ctx);
+    case ConsoleCmdProfile:
+        return cmd_profile(world, args, ctx);
+    case ConsoleCmdFrame:
+        return cmd_frame(world, args, ctx);
+    case ConsoleCmdDiff:
+        return cmd_diff(world, args, ctx);
+    case ConsoleCmdBegin:
+        return cmd_begin(ctx);
+    case ConsoleCmdCommit:
+        return cmd_commit(world, ctx);
+    case ConsoleCmdAbort:
+        return cmd_abort(ctx);
+    case ConsoleCmdChurn:
+        return cmd_churn(world, args, ctx);
+    case ConsoleCmdMemory:
+        return cmd_memory(world, args, ctx);
+    case ConsoleCmdLayout:
+        return cmd_layout(world, args, ctx);
+    case ConsoleCmdMatrix:
+        return cmd_matrix(world, args, ctx);
+    case ConsoleCmdCount:
+        return cmd_count(world, args, ctx);
+    case ConsoleCmdTop:
+        return cmd_top(world, args, ctx);
+    }
+
+    return -1;
 }
 
-int cmd_snapshot(
-    ecs_world_t *world, 
-    const char *args, 
+static
+int parse_option(
+    const char *option,
+    const char *value,
     ui_thread_t *ctx)
 {
-    if (ctx->snapshot) {
-        ecs_snapshot_free(world, ctx->snapshot);
-    }
-
-    if (args[0] == '[') {
-        ecs_type_filter_t filter = {0};
-        if (parse_type_filter(world, args, &filter)) {
+    if (!strcmp(option, "format")) {
+        if (!strcmp(value, "text")) {
+            ctx->format = ConsoleText;
+        } else if (!strcmp(value, "json")) {
+            ctx->format = ConsoleJson;
+        } else if (!strcmp(value, "csv")) {
+            ctx->format = ConsoleCsv;
+        } else {
+            return -1;
+        }
+    } else if (!strcmp(option, "limit")) {
+        ctx->limit = atoi(value);
+        if (ctx->limit <= 0) {
+            return -1;
+        }
+    } else if (!strcmp(option, "offset")) {
+        ctx->offset = atoi(value);
+        if (ctx->offset < 0) {
+            return -1;
+        }
+    } else if (!strcmp(option, "by")) {
+        if (strlen(value) >= sizeof(ctx->by)) {
+            return -1;
+        }
+        strcpy(ctx->by, value);
+    } else if (!strcmp(option, "compress")) {
+        if (!strcmp(value, "lz")) {
+            ctx->compress = true;
+        } else if (!strcmp(value, "none")) {
+            ctx->compress = false;
+        } else {
             return -1;
         }
-
-        ctx->snapshot = ecs_snapshot_take(world, &filter);
     } else {
-        ctx->snapshot = ecs_snapshot_take(world, NULL);
+        return -1;
     }
 
     return 0;
 }
 
-int cmd_restore(
-    ecs_world_t *world,
+/* Remove --option value pairs from a command and apply them to the context.
+ * Options inside a type expression are left alone. */
+static
+char* parse_options(
+    const char *cmd,
     ui_thread_t *ctx)
 {
-    if (!ctx->snapshot) {
-        return -1;
+    char *result = ecs_os_malloc(strlen(cmd) + 1), *bptr = result;
+    const char *ptr = cmd;
+    int32_t depth = 0;
+
+    ctx->format = ConsoleText;
+    ctx->limit = 0;
+    ctx->offset = 0;
+    ctx->compress = false;
+    ctx->by[0] = '\0';
+    ctx->by_component = false;
+
+    while (*ptr) {
+        char ch = *ptr;
+
+        if (!depth && ch == '-' && ptr[1] == '-' && 
+           (ptr == cmd || isspace(ptr[-1]))) 
+        {
+            char option[32], value[64];
+            ptr = parse_word(ptr + 2, option, sizeof(option));
+
+            /* Options without a value */
+            if (!strcmp(option, "by-component")) {
+                ctx->by_component = true;
+                continue;
+            }
+
+            ptr = parse_word(ptr, value, sizeof(value));
+
+            if (parse_option(option, value, ctx)) {
+                ecs_os_free(result);
+                return NULL;
+            }
+
+            continue;
+        }
+
+        if (ch == '[') {
+            depth ++;
+        } else if (ch == ']') {
+            depth --;
+        }
+
+        /* Collapse whitespace left behind by a removed option */
+        if (!depth && isspace(ch) && (bptr == result || isspace(bptr[-1]))) {
+            ptr ++;
+            continue;
+        }
+
+        *(bptr ++) = ch;
+        ptr ++;
     }
 
-    ecs_snapshot_restore(world, ctx->snapshot);
-    
-    ctx->snapshot = NULL;
+    while (bptr != result && isspace(bptr[-1])) {
+        bptr --;
+    }
 
-    return 0;
+    *bptr = '\0';
+
+    return result;
 }
 
 static
@@ -840,69 +7892,59 @@ int parse_cmd(
     const char *cmd,
     ui_thread_t *ctx) 
 {
-    const char *args;
-
-    if (!cmd[0]) {
-        return 0;
+    char *stripped = parse_options(cmd, ctx);
+    if (!stripped) {
+        return -1;
     }
 
-    if ((args = is_cmd(cmd, "table"))) {
-        return cmd_table(world, args);
-    } else
-    if ((args = is_cmd(cmd, "system"))) {
-        return cmd_system(world, args);
-    } else
-    if ((args = is_cmd(cmd, "entity"))) {
-        return cmd_entity(world, args);
-    } else
-    if ((args = is_cmd(cmd, "match"))) {
-        return cmd_match(world, args);
-    } else
-    if ((args = is_cmd(cmd, "add"))) {
-        return cmd_add_remove(world, args, false);
-    } else
-    if ((args = is_cmd(cmd, "remove"))) {
-        return cmd_add_remove(world, args, true);
-    } else    
-    if ((args = is_cmd(cmd, "delete"))) {
-        return cmd_delete(world, args);
-    } else
-    if ((args = is_cmd(cmd, "help"))) {
-        cmd_help();
-        return 0;
-    } else
-    if ((args = is_cmd(cmd, "quit"))) {
-        ecs_quit(world);
-        return 0;
-    } else
-    if ((args = is_cmd(cmd, "snapshot"))) {
-        return cmd_snapshot(world, args, ctx);
-    } else
-    if ((args = is_cmd(cmd, "restore"))) {
-        return cmd_restore(world, ctx);
-    }
+    int result = exec_cmd(world, stripped, ctx);
 
-    return -1;
+    ecs_os_free(stripped);
+
+    return result;
 }
 
 static
 void* ui_thread(void *arg) {
     ui_thread_t *ctx = arg;
-    ecs_world_t *world = ctx->world;
 
     ecs_os_sleep(0, 100000000);
 
     while (true) {
         show_prompt();
-        char *cmd = read_cmd(stdin);
 
-        ecs_os_mutex_lock(ctx->mutex);
-        if (parse_cmd(world, cmd, ctx)) {
-            printf("error executing '%s'\n", cmd);
+        console_cmd_t *cmd = ecs_os_malloc(sizeof(console_cmd_t));
+        cmd->cmd = read_cmd(stdin);
+        cmd->result = 0;
+
+        /* The terminal delivers a tab when the line is submitted, so a line
+         * with a tab is turned into a request to complete what came before */
+        char *tab = strchr(cmd->cmd, '\t');
+        if (tab) {
+            *tab = '\0';
+            char *complete = ecs_os_malloc(strlen(cmd->cmd) + 10);
+            sprintf(complete, "complete %s", cmd->cmd);
+            ecs_os_free(cmd->cmd);
+            cmd->cmd = complete;
+        }
+
+        /* Hand the command to the main thread. The UI thread is the only one
+         * that waits, so the simulation never blocks on console input. */
+        while (!queue_push(&ctx->commands, cmd)) {
+            ecs_os_sleep(0, 1000000);
+        }
+
+        console_cmd_t *done;
+        while (!(done = queue_pop(&ctx->results))) {
+            ecs_os_sleep(0, 1000000);
+        }
+
+        if (done->result) {
+            printf("error executing '%s'\n", done->cmd);
         }
-        ecs_os_mutex_unlock(ctx->mutex);
 
-        free(cmd);
+        ecs_os_free(done->cmd);
+        ecs_os_free(done);
     }
 
     return NULL;
@@ -913,15 +7955,19 @@ void EcsStartUiThread(ecs_rows_t *rows) {
     ECS_COLUMN_COMPONENT(rows, ConsoleUiThread, 2);
 
     for (uint32_t i = 0; i < rows->count; i ++) {
-        ui_thread_t *ctx = ecs_os_malloc(sizeof(ui_thread_t));
+        ui_thread_t *ctx = ecs_os_calloc(1, sizeof(ui_thread_t));
         ctx->world = rows->world;
         ctx->console_entity = rows->entities[i];
-        ctx->mutex = ecs_os_mutex_new();
-        ctx->snapshot = NULL;
-
-        /* Lock mutex, which will prevent the thread from doing unsafe access
-         * on the world */
-        ecs_os_mutex_lock(ctx->mutex);
+        ctx->commands = (console_queue_t){0};
+        ctx->results = (console_queue_t){0};
+        ctx->current = NULL;
+        ctx->job = (console_job_t){0};
+        ctx->budget = CONSOLE_DEFAULT_BUDGET;
+        ctx->cache = (console_cache_t){0};
+        ctx->out = (console_buf_t){0};
+        ctx->profile = (console_profile_t){0};
+        ctx->frames = ecs_os_calloc(1, sizeof(console_frames_t));
+        trie_build(ctx);
 
         ecs_set(
             rows->world,
@@ -939,15 +7985,57 @@ void EcsRunConsole(ecs_rows_t *rows) {
     ECS_COLUMN(rows, ConsoleUiThread, thr, 1);
 
     ui_thread_t *ctx = thr->ctx;
+    ecs_world_t *world = rows->world;
+
+    frame_record(world, ctx->frames, rows->delta_time);
+    names_update(world, &ctx->cache.names);
+
+    if (ctx->churn.enabled) {
+        churn_record(world, &ctx->churn);
+    }
+
+    /* Commands are executed on the main thread, so they can safely access the
+     * world. When the console is idle this is a single atomic load. */
+    console_cmd_t *cmd = ctx->current;
+    ecs_time_t start;
+    ecs_os_get_time(&start);
 
-    /* Unlock and relock the mutex to give the UI thread the opportunity to
-     * do operations */
-    ecs_os_mutex_unlock(ctx->mutex);
+    while (cmd || (cmd = queue_pop(&ctx->commands))) {
+        console_job_t *job = &ctx->job;
 
-    /* ui thread does something ... */
-    ecs_os_sleep(0, 10000000);
+        if (!job->step) {
+            cache_validate(world, &ctx->cache);
+            cmd->result = parse_cmd(world, cmd->cmd, ctx);
+        }
+
+        /* Listings that visit the whole world run as a job, which continues
+         * where it left off when it runs out of budget */
+        if (!cmd->result && job->step) {
+            job->start = start;
+            job->budget = ctx->budget;
+            job->ops = 0;
+
+            cache_validate(world, &ctx->cache);
+            int result = job->step(world, ctx);
+            if (result == CONSOLE_MORE) {
+                buf_flush(&ctx->out);
+                ctx->current = cmd;
+                return;
+            }
+
+            cmd->result = result;
+        }
+
+        *job = (console_job_t){0};
+        scan_stop(&ctx->pool);
+        ctx->current = NULL;
+        buf_flush(&ctx->out);
 
-    ecs_os_mutex_lock(ctx->mutex);
+        /* The UI thread waits for each result before reading the next
+         * command, so the result queue can never be full */
+        queue_push(&ctx->results, cmd);
+        cmd = NULL;
+    }
 }
 
 void FlecsSystemsConsoleImport(
@@ -964,7 +8052,5 @@ void FlecsSystemsConsoleImport(
     ECS_SYSTEM(world, EcsStartUiThread, EcsOnAdd, EcsConsole, .ConsoleUiThread);
     ECS_SYSTEM(world, EcsRunConsole, EcsOnStore, ConsoleUiThread);
 
-    ecs_set_period(world, EcsRunConsole, 0.1);
-
     ECS_EXPORT_COMPONENT(EcsConsole);
 }